@@ -9,65 +9,166 @@
 #ifndef ADC_DIAGNOSTIC_H_
 #define ADC_DIAGNOSTIC_H_
 
-double AIN1, AIN2, AIN3;
+uint16_t AIN1, AIN2, AIN3;	//SSR sense voltages in millivolts
 
-double ADCpinSel_and_output (uint8_t pinNum);
+//ADC0 scans the solar panel and the fill, BB2 and clean SSR sense inputs
+//in the background, one channel after the other, see board.h. Each result
+//is the sum of 16 accumulated conversions.
+#define ADC_FIRST_CHANNEL BOARD_AIN_SOLAR
+#define ADC_CHANNELS 4				//solar, fill, BB2 and clean
+#define ADC_SAMPLES 16				//conversions accumulated per result
+//Voltages are handled as whole millivolts. One count of a single 12 bit
+//conversion is 1/1.6 mV, so an accumulated result converts as
+//sum * 1000 / (1600 * 16) = sum * 5 / 128. Dropping the low 3 bits first
+//keeps the product in 16 bits at a cost of under 1 mV.
+#define ADC_SUM_TO_MV(sum) ((((sum) >> 3) * 5) >> 4)
+#define ADC_GOOD_MV 1000			//POST passes above 1V
+//POST results, a set bit is a check that passed
+#define POST_FILL_bm 0x01
+#define POST_BB2_bm 0x02
+#define POST_CLEAN_bm 0x04
+#define POST_SOLAR_bm 0x08
+volatile uint16_t adc_latest[ADC_CHANNELS];	//latest accumulated result per channel
+seq_t adc_seq = 0;							//bumped by the ISR around adc_latest writes
+volatile uint8_t adc_channel = 0;			//index of the channel being converted
+volatile uint8_t adc_scan_count = 0;		//increments after every full scan
+uint8_t post_scan;							//adc_scan_count when the POST started
+uint8_t post_result = 0;					//POST_*_bm of the checks that passed
+
+uint16_t ADCpinSel_and_output (uint8_t pinNum);
 void ADC0_init(void);
 void runDiagnostics(void);
-double solarConversion(void);
-void POST(void);
+uint16_t solarConversion(void);
+void post_start(void);
+uint8_t post_poll(void);
+uint16_t adc_read_sum(uint8_t pinNum);
 
 #endif /* ADC_DIAGNOSTIC_H_ */
 
-double ADCpinSel_and_output (uint8_t pinNum){
-	double adcVal;
-	ADC0.MUXPOS = pinNum;
-	ADC0.COMMAND = 0x01; // start the conversion
-	while (!(ADC0.INTFLAGS & ADC_RESRDY_bm));
-	adcVal = ADC0.RES/1600.0; // read the value into adcVal
-	ADC0.INTFLAGS = ADC_RESRDY_bm; // clear the flag
-	return adcVal;
+//***************************************************************************
+//
+// Function Name        : "ADC0_RESRDY_vect Interrupt"
+// Date                 : 10/17/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ADC0
+// Author               : Vanessa Li
+// DESCRIPTION
+// Runs when ADC0 has accumulated ADC_SAMPLES conversions of one channel.
+// The result is stored in adc_latest and the next channel is started, so
+// the ADC keeps cycling through AIN3-AIN6 on its own.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//						  v1.1 adc_seq around the store, adc_read_sum() no
+//								longer turns interrupts off
+//
+//**************************************************************************
+ISR(ADC0_RESRDY_vect){
+	seq_write(&adc_seq);
+	adc_latest[adc_channel] = ADC0.RES;	//reading RES clears the flag
+	seq_write(&adc_seq);
+	if(++adc_channel == ADC_CHANNELS) {
+		adc_channel = 0;
+		adc_scan_count++;
+	}
+	ADC0.MUXPOS = ADC_FIRST_CHANNEL + adc_channel;
+	ADC0.COMMAND = ADC_STCONV_bm; // start the next conversion
+}
+
+//returns the latest accumulated result for pinNum, AIN3 to AIN6
+uint16_t adc_read_sum(uint8_t pinNum){
+	uint16_t sum;
+	uint8_t start;
+	do {
+		start = seq_read_begin(&adc_seq);
+		HAL_COPY(sum, adc_latest[pinNum - ADC_FIRST_CHANNEL]);
+	} while(seq_read_retry(&adc_seq, start));
+	return sum;
+}
+
+//returns the latest background result for pinNum in millivolts without
+//waiting on the ADC
+uint16_t ADCpinSel_and_output (uint8_t pinNum){
+	return ADC_SUM_TO_MV(adc_read_sum(pinNum));
 }
 
 
 void ADC0_init(void){
 	VREF.ADC0REF = VREF_REFSEL_2V048_gc;
+	ADC0.CTRLB = ADC_SAMPNUM_ACC16_gc;	//accumulate 16 conversions per result
 	ADC0.CTRLC = ADC_PRESC_DIV128_gc;
+	ADC0.INTCTRL = ADC_RESRDY_bm;		//interrupt when a result is ready
 	ADC0.CTRLA |= ADC_ENABLE_bm;
 	
-	/* Disable interrupt and digital input buffer on PD3 */
-	PORTD.PIN3CTRL &= ~PORT_ISC_gm;
-	PORTD.PIN3CTRL |= PORT_ISC_INPUT_DISABLE_gc;
-	/* Disable interrupt and digital input buffer on PD4 */
-	PORTD.PIN4CTRL &= ~PORT_ISC_gm;
-	PORTD.PIN4CTRL |= PORT_ISC_INPUT_DISABLE_gc;
-	/* Disable interrupt and digital input buffer on PD5 */
-	PORTD.PIN5CTRL &= ~PORT_ISC_gm;
-	PORTD.PIN5CTRL |= PORT_ISC_INPUT_DISABLE_gc;
-	/* Disable interrupt and digital input buffer on PD6 */
-	PORTD.PIN5CTRL &= ~PORT_ISC_gm;
-	PORTD.PIN5CTRL |= PORT_ISC_INPUT_DISABLE_gc;
+	/* Disable interrupt and digital input buffer on every scanned pin */
+	for (uint8_t i = 0; i < ADC_CHANNELS; i++) {
+		board_analog_input(ADC_FIRST_CHANNEL + i);
+	}
+	
+	ADC0.MUXPOS = ADC_FIRST_CHANNEL;
+	ADC0.COMMAND = ADC_STCONV_bm; // start the background scan
 }
 
 void runDiagnostics(void) {
-	PORTA.OUT |= 0b00001100; //enable fill and clean SSR
-	PORTD.OUT |= 0b10000010; //enable BB2 SSR and ENAC-
-	AIN1 = ADCpinSel_and_output(0x04);
-	AIN2 = ADCpinSel_and_output(0x05);
-	AIN3 = ADCpinSel_and_output(0x06);
+	valve_test(1); //enable fill, clean and BB2 SSR and ENAC-
+	AIN1 = ADCpinSel_and_output(BOARD_AIN_FILL);
+	AIN2 = ADCpinSel_and_output(BOARD_AIN_BB2);
+	AIN3 = ADCpinSel_and_output(BOARD_AIN_CLEAN);
 }
 
-double solarConversion(void) {
-	return ADCpinSel_and_output(0x03);
+uint16_t solarConversion(void) {
+	return ADCpinSel_and_output(BOARD_AIN_SOLAR);
 }
 
-void POST(void) { //run power-on self-test
+//***************************************************************************
+//
+// Function Name        : "post_start"
+// Date                 : 10/17/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; SSRs, ADC0
+// Author               : Vanessa Li
+// DESCRIPTION
+// Starts the power-on self-test. Turns every SSR on, post_poll() takes the
+// results once the background scan has seen them on.
+//
+// Warnings             : Every valve is open until post_poll() returns 1
+// Restrictions         : ADC0_init() must have run
+// Algorithms           : none
+// References           : post_poll()
+//
+// Revision History     : Initial version
+//						  v1.1 Split into post_start and post_poll, the
+//								results are no longer waited for or shown
+//								here, see boot.h
+//
+//**************************************************************************
+void post_start(void) {
 	runDiagnostics();
-	snprintf(dsp_buff1, 21, "Power-On Self Tests ");
-	snprintf(dsp_buff2, 21, "FILL-%s  WIFI-GOOD", ((AIN1 > 1) ? "GOOD" : "FAIL"));
-	snprintf(dsp_buff3, 21, " CLN-%s  SOLR-%s", ((AIN3 > 1) ? "GOOD" : "FAIL"), 
-												((solarConversion() > 1) ? "GOOD" : "FAIL"));
-	snprintf(dsp_buff4, 21, " BB2-%s           ",((AIN2 > 1) ? "GOOD" : "FAIL"));
-	update_lcd_dog();
-	_delay_ms(10000);
-}
\ No newline at end of file
+	post_scan = adc_scan_count;
+}
+
+//returns 0 while the POST waits for the ADC. Once a full scan has started
+//and finished with the SSRs on, stores the results in post_result, turns
+//the SSRs off again and returns 1.
+uint8_t post_poll(void) {
+	if((uint8_t)(adc_scan_count - post_scan) < 2)
+		return 0;
+	runDiagnostics();
+	post_result = 0;
+	if(AIN1 > ADC_GOOD_MV)
+		post_result |= POST_FILL_bm;
+	if(AIN2 > ADC_GOOD_MV)
+		post_result |= POST_BB2_bm;
+	if(AIN3 > ADC_GOOD_MV)
+		post_result |= POST_CLEAN_bm;
+	if(solarConversion() > ADC_GOOD_MV)
+		post_result |= POST_SOLAR_bm;
+	valve_test(0); //turn off fill, clean and BB2 SSR and ENAC-
+	return 1;
+}
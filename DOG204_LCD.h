@@ -14,110 +14,273 @@ char dsp_buff2[21];
 char dsp_buff3[21];
 char dsp_buff4[21];
 
+//copy of the 80 characters currently on the glass, line by line
+char lcd_shadow[80];
+//number of SPI bytes the last call to update_lcd_dog() sent, the "frames"
+//command prints it
+uint16_t lcd_frame_bytes = 0;
+
+//The main loop only redraws the screen while lcd_dirty is set, and at most
+//once every LCD_FRAME_TICKS ticks of the 5ms button tick.
+#ifndef LCD_FRAME_TICKS
+#define LCD_FRAME_TICKS 20		//10 frames per second
+#endif
+volatile uint8_t lcd_dirty = 1;		//1 when the screen has to be redrawn
+uint16_t lcd_frames_rendered = 0;	//main loop passes that redrew the screen
+uint16_t lcd_frames_skipped = 0;	//main loop passes that did not
+
+//DDRAM address commands for the start of each line
+const uint8_t lcd_line_addr[4] = {0x80, 0xA0, 0xC0, 0xE0};
+
+//SPI transmit queue, drained by the SPI0 and TCB0 interrupts.
+//Only 0x00-0x0F, 0x1F and 0x5F ever go out on the wire, so the
+//remaining values are free to mark delays in the queue.
+#define LCD_QUEUE_SIZE 256		//must stay 256, the uint8_t indices wrap on their own
+#define LCD_Q_SETTLE 0xF0		//command settle gap
+#define LCD_Q_DELAY_MS 0xF1		//delay, next entry holds the number of milliseconds
+#define LCD_SETTLE_TICKS 99		//50us at F_CPU/2, the period is CCMP + 1
+#define LCD_MS_TICKS 1999		//1ms at F_CPU/2
+//queue entries one line of update_lcd_dog() takes at most, an address
+//command, its settle gap and 20 characters of 3 bytes each
+#define LCD_LINE_MAX 64
+volatile uint8_t lcd_queue[LCD_QUEUE_SIZE];
+volatile uint8_t lcd_q_head = 0;		//next free slot, written by the main loop
+volatile uint8_t lcd_q_tail = 0;		//next entry to send, written by the ISRs
+volatile uint8_t lcd_spi_active = 0;	//1 while the ISRs are draining the queue
+volatile uint8_t lcd_delay_ms = 0;		//milliseconds left of a queued delay
+
 void lcd_spi_transmit_CMD (unsigned char cmd);
 void lcd_spi_transmit_DATA (unsigned char cmd);
 void init_spi_lcd (void);
 void init_lcd_dog (void);
-void delay_40mS(void);
-void delay_30uS(void);
-void update_lcd_dog(void);
-void SPI0_wait();
+void delay_30uS(void);
+uint8_t update_lcd_dog(void);
+void clear_display(void);
+void lcd_queue_put(const uint8_t *bytes, uint8_t count);
+void lcd_spi_next(void);
+void lcd_settle(void);
+void lcd_delay(uint8_t ms);
 
 
 
 #endif /* DOG204_LCD_H_ */
 
-//***************************************************************************
-//
-// Function Name : "SPI_wait"
-// Date : 9/14/21
-// Version : 1.0
-// Target MCU : AVR128DB48
-// Target Hardware ;
-// Author : Brandon Guzy
-// DESCRIPTION
-// This function waits until the interrupt flags for SPI are clear
-//before proceeding
-//
-// Warnings : none
-// Restrictions : none
-// Algorithms : none
-// References : none
-//
-// Revision History : Initial version
-//
+//***************************************************************************
+//
+// Function Name        : "lcd_queue_put"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// This function appends count bytes to the LCD transmit queue and starts
+// the SPI engine if it is idle. The bytes are published together, so a
+// delay token and its argument are never seen apart by the ISRs. The queue
+// is drained in the background by the SPI0 and TCB0 interrupts.
+//
+// Warnings             : Waits for room when the queue is full, so it must
+//						  not be called from an interrupt
+// Restrictions         : Before sei() only LCD_QUEUE_SIZE - 1 bytes may be
+//						  queued, since nothing drains the queue until then
+// Algorithms           : Single producer/single consumer ring buffer, the
+//						  8 bit indices wrap on their own at 256 entries
+// References           : lcd_spi_next()
+//
+// Revision History     : Initial version
+//
 //**************************************************************************
-void SPI0_wait(){
-	//wait until there is no data waiting to be written or read
-	while((SPI0.INTFLAGS & 0b11000000) != 0x80 ){ 
-		asm volatile("nop");
+void lcd_queue_put(const uint8_t *bytes, uint8_t count) {
+	uint8_t head = lcd_q_head;
+	while((uint8_t)(lcd_q_tail - head - 1) < count)	//wait for the ISRs to make room
+	{
+		hal_idle();
 	}
-}
-
-void delay_40mS(void){
-	_delay_ms(40);
+	for (uint8_t i = 0; i < count; i++) {
+		lcd_queue[head++] = bytes[i];
+	}
+	lcd_q_head = head;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(!lcd_spi_active) {
+			lcd_spi_active = 1;
+			lcd_spi_next();
+		}
+	}
+}
+
+//***************************************************************************
+//
+// Function Name        : "lcd_spi_next"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// This function takes the next entry off the LCD transmit queue. Data bytes
+// are written to SPI0 and the SPI0 interrupt calls back in when the byte has
+// been shifted out. Delay tokens start TCB0 instead, and the TCB0 interrupt
+// calls back in when the delay has run out.
+//
+// Warnings             : none
+// Restrictions         : Must run with interrupts disabled, either from an
+//						  ISR or inside an ATOMIC_BLOCK
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void lcd_spi_next(void) {
+	uint8_t byte;
+	if(lcd_q_tail == lcd_q_head) {
+		lcd_spi_active = 0;		//queue drained
+		return;
+	}
+	byte = lcd_queue[lcd_q_tail++];
+	if(byte == LCD_Q_SETTLE) {
+		lcd_delay_ms = 0;
+		TCB0.CCMP = LCD_SETTLE_TICKS;
+	}else if(byte == LCD_Q_DELAY_MS) {
+		lcd_delay_ms = lcd_queue[lcd_q_tail++];
+		TCB0.CCMP = LCD_MS_TICKS;
+	}else {
+		hal_spi_write(byte);
+		return;
+	}
+	TCB0.CNT = 0;
+	TCB0.CTRLA = TCB_CLKSEL_DIV2_gc | TCB_ENABLE_bm;
+}
+
+//***************************************************************************
+//
+// Function Name        : "SPI0_INT_vect Interrupt"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Runs when a byte has been shifted out to the LCD and moves on to the
+// next queue entry
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : lcd_spi_next()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+ISR(SPI0_INT_vect){
+	(void)SPI0.INTFLAGS;	//reading INTFLAGS then DATA clears the IF flag
+	(void)SPI0.DATA;
+	lcd_spi_next();
+}
+
+//***************************************************************************
+//
+// Function Name        : "TCB0_INT_vect Interrupt"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Runs when a queued settle gap or millisecond of a queued delay has passed.
+// The timer keeps running until the last millisecond, then it is stopped and
+// the queue moves on.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : lcd_spi_next()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+ISR(TCB0_INT_vect){
+	TCB0.INTFLAGS = TCB_CAPT_bm;	//clear interrupt flag
+	if(lcd_delay_ms > 1) {
+		lcd_delay_ms--;
+		return;
+	}
+	TCB0.CTRLA = 0;		//stop the timer
+	lcd_spi_next();
 }
 
 void delay_30uS(void){
 	_delay_us(50);
 }
 
-//***************************************************************************
-//
-// Function Name        : "lcd_spi_transmit_DATA"
-// Date                 : 9/14/21
-// Version              : 1.0
-// Target MCU           : AVR128DB48
-// Target Hardware      ; ST7036 + LCD
-// Author               : Brandon Guzy
-// DESCRIPTION
-// This function transmits data to the LCD
-//
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
-//
-// Revision History     : Initial version
-//
+//queue a settle gap after a command so the ST7036 can process it
+void lcd_settle(void){
+	uint8_t token = LCD_Q_SETTLE;
+	lcd_queue_put(&token, 1);
+}
+
+//queue a delay of ms milliseconds, 1 to 255
+void lcd_delay(uint8_t ms){
+	uint8_t token[2] = {LCD_Q_DELAY_MS, ms};
+	lcd_queue_put(token, 2);
+}
+
+//***************************************************************************
+//
+// Function Name        : "lcd_spi_transmit_DATA"
+// Date                 : 9/14/21
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// This function queues data to be transmitted to the LCD
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : lcd_queue_put()
+//
+// Revision History     : Initial version
+//						  v1.1 Queue the bytes instead of waiting on SPI0
+//
 //**************************************************************************
-void lcd_spi_transmit_DATA (unsigned char cmd) {
-	SPI0.DATA = 0x5F;	//Send 5 synchronization bits, RS = 1, R/W = 0
-	SPI0_wait();
-	SPI0.DATA = cmd & 0x0F;	//transmit lower data bits
-	SPI0_wait();
-	SPI0.DATA = ((cmd>>4) & 0x0F);	//send higher data bits
-	SPI0_wait();
-}
-
-//***************************************************************************
-//
-// Function Name        : "lcd_spi_transmit_CMD"
-// Date                 : 9/14/21
-// Version              : 1.0
-// Target MCU           : AVR128DB48
-// Target Hardware      ; ST7036 + LCD
-// Author               : Brandon Guzy
-// DESCRIPTION
-// This function transmits a command to the LCD, RS =0
-//
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
-//
-// Revision History     : Initial version
-//
+void lcd_spi_transmit_DATA (unsigned char cmd) {
+	uint8_t bytes[3];
+	bytes[0] = 0x5F;	//Send 5 synchronization bits, RS = 1, R/W = 0
+	bytes[1] = cmd & 0x0F;	//transmit lower data bits
+	bytes[2] = (cmd>>4) & 0x0F;	//send higher data bits
+	lcd_queue_put(bytes, 3);
+}
+
+//***************************************************************************
+//
+// Function Name        : "lcd_spi_transmit_CMD"
+// Date                 : 9/14/21
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// This function queues a command to be transmitted to the LCD, RS =0
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : lcd_queue_put()
+//
+// Revision History     : Initial version
+//						  v1.1 Queue the bytes instead of waiting on SPI0
+//
 //**************************************************************************
-void lcd_spi_transmit_CMD (unsigned char cmd) {
-	SPI0.DATA = 0x1F;	//Send 5 synchronisation bits, RS = 0, R/W = 0
-	SPI0_wait();
-	SPI0.DATA = cmd & 0x0F;	//transmit lower data bits
-	SPI0_wait();
-	SPI0.DATA = ((cmd>>4) & 0x0F);	//send higher data bits
-	SPI0_wait();
-}
-
+void lcd_spi_transmit_CMD (unsigned char cmd) {
+	uint8_t bytes[3];
+	bytes[0] = 0x1F;	//Send 5 synchronisation bits, RS = 0, R/W = 0
+	bytes[1] = cmd & 0x0F;	//transmit lower data bits
+	bytes[2] = (cmd>>4) & 0x0F;	//send higher data bits
+	lcd_queue_put(bytes, 3);
+}
+
 //***************************************************************************
 //
 // Function Name        : "init_spi_lcd"
@@ -131,25 +294,31 @@ void lcd_spi_transmit_CMD (unsigned char cmd) {
 // necessary to communicate with the LCD.
 // Does not initialize any values on the LCD, only the AVR128
 // Uses the standard SPI pins (PA7,6,4) for SPI communication
-// PA7 = Slave Select, PA4 = MOSI, PA6 = SCK
-// and PC0 for command select, RS = 1 for data, RS = 0 for command
-//
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
-//
-// Revision History     : Initial version
+// PA7 = Slave Select, PA4 = MOSI, PA6 = SCK
+// and PC0 for command select, RS = 1 for data, RS = 0 for command
+// TCB0 is set up as the one-shot timer for queued LCD delays
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//						  v1.1 Enable the SPI0 interrupt, set up TCB0
+//						  v1.2 Pins from board.h
 //
 //**************************************************************************
 void init_spi_lcd(){
-	PORTA.DIR |= 0b11010000;	//enable output on necessary port A pins
+	PORTA.DIR |= BOARD_LCD_SPI_A;	//enable output on necessary port A pins
 	SPI0.CTRLA = 0b01100001;	//enable SPI, set in master mode, LSB First
 	SPI0.CTRLB = 0b00000000;	//disable buffer, slave select enabled, normal mode
-	PORTC.DIR = 0x01;			//enable output on port C0
-	PORTA.OUT &= 0b01111111;	//clear Pin A7 to reset.
+	SPI0.INTCTRL = SPI_IE_bm;	//interrupt when a byte has been sent
+	TCB0.CTRLB = TCB_CNTMODE_INT_gc;	//periodic interrupt mode for queued delays
+	TCB0.INTCTRL = TCB_CAPT_bm;
+	PORTC.DIR = BOARD_LCD_RS_C;	//enable output on port C0
+	PORTA.OUT &= ~BOARD_LCD_CS_A;	//clear Pin A7 to reset.
 	delay_30uS();
-	PORTA.OUT |= 0x80;			//set high to finish reset
+	PORTA.OUT |= BOARD_LCD_CS_A;	//set high to finish reset
 }
 
 //***************************************************************************
@@ -161,22 +330,24 @@ void init_spi_lcd(){
 // Target Hardware      ; ST7036 + LCD
 // Author               : Brandon Guzy
 // DESCRIPTION
-// This program initializes the DOG LCD so it is ready to be sent lines.
-// This program sends several commands using the spi_transmit_CMD function
-//
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
-//
-// Revision History     : Initial version
+// This program initializes the DOG LCD so it is ready to be sent lines.
+// This program queues several commands using the spi_transmit_CMD function,
+// they are sent in the background once interrupts are enabled
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//						  v1.1 Queue the startup delay instead of waiting
 //
 //**************************************************************************
 void init_lcd_dog (void) {
 	init_spi_lcd();		//Initialize mcu for LCD SPI
 	
 	//start_dly_40ms:
-	delay_40mS();    //startup delay.
+	lcd_delay(40);    //startup delay.
 
 
 	//func_set1:
@@ -222,64 +393,78 @@ void init_lcd_dog (void) {
 	//display_on
 	lcd_spi_transmit_CMD(0x0C);	//Display on, Cursor off, Blink off
 	
-	lcd_spi_transmit_CMD(0x01);		//clear display
+	clear_display();
 }
 
 //***************************************************************************
 //
 // Function Name        : "update_lcd_dog"
 // Date                 : 9/14/21
-// Version              : 1.0
+// Version              : 1.3
 // Target MCU           : AVR128DB48
 // Target Hardware      ; ST7036 + LCD
 // Author               : Brandon Guzy
 // DESCRIPTION
-// This program updates the LCD with the characters from the 3 line buffers
+// This program updates the LCD with the characters from the 4 line buffers.
+// Each buffer is compared against lcd_shadow and only the cells that changed
+// are sent. Changed cells are grouped into runs so one DDRAM address command
+// covers a run, a single unchanged cell between two runs is resent instead
+// of paying for another address command and its settle delay.
+// A line is only queued if the queue has room for all of it, a full redraw
+// is more than the queue holds. Returns 0 if lines were left for the next
+// call, which sends only them, 1 once the whole frame is queued.
 //
 // Warnings             : none
-// Restrictions         : none
+// Restrictions         : lcd_shadow must match the glass, so every write to
+//						  the LCD has to go through this function or
+//						  clear_display()
 // Algorithms           : none
 // References           : none
 //
-// Revision History     : Initial version
+// Revision History     : Initial version
+//						  v1.1 Only send changed characters, count SPI bytes
+//								per frame in lcd_frame_bytes
+//						  v1.2 Returns as soon as the frame is queued
+//						  v1.3 Leaves the lines that do not fit in the queue
+//								for the next call instead of waiting
 //
 //**************************************************************************
-void update_lcd_dog(void) {
+uint8_t update_lcd_dog(void) {
+	char *lines[4] = {dsp_buff1, dsp_buff2, dsp_buff3, dsp_buff4};
+	uint16_t bytes = 0;
 
-	// send line 1 to the LCD module.
-	lcd_spi_transmit_CMD(0x80);	//init DDRAM addr-ctr
-	delay_30uS();
-	for (int i = 0; i < 20; i++) {
-		if(dsp_buff1[i] == '\0')
-			break;
-		lcd_spi_transmit_DATA(dsp_buff1[i]);
-	}
-	
-	// send line 2 to the LCD module.
-	lcd_spi_transmit_CMD(0xA0);	//init DDRAM addr-ctr
-	delay_30uS();
-	for (int i = 0; i < 20; i++) {
-		if(dsp_buff2[i] == '\0')
-			break;
-		lcd_spi_transmit_DATA(dsp_buff2[i]);
-	}
-	
-	// send line 3 to the LCD module.
-	lcd_spi_transmit_CMD(0xC0);	//init DDRAM addr-ctr
-	delay_30uS();
-	for (int i = 0; i < 20; i++) {
-		if(dsp_buff3[i] == '\0')
-			break;
-		lcd_spi_transmit_DATA(dsp_buff3[i]);
-	}
-	lcd_spi_transmit_CMD(0xE0);	//init DDRAM addr-ctr
-	for (int i = 0; i < 20; i++) {
-		if(dsp_buff4[i] == '\0')
-			break;
-		lcd_spi_transmit_DATA(dsp_buff4[i]);
+	for (uint8_t line = 0; line < 4; line++) {
+		char *shadow = &lcd_shadow[line * 20];
+		int8_t next = -1;	//column the DDRAM address counter points at, -1 if unknown
+		if((uint8_t)(lcd_q_tail - lcd_q_head - 1) < LCD_LINE_MAX) {
+			lcd_frame_bytes = bytes;
+			return 0;		//lcd_shadow still differs, the next call carries on
+		}
+		for (int8_t i = 0; i < 20; i++) {
+			if(lines[line][i] == '\0')
+				break;		//cells past the end of the string are left as they are
+			if(lines[line][i] == shadow[i])
+				continue;
+			if(next >= 0 && i - next == 1) {	//bridge a one cell gap
+				lcd_spi_transmit_DATA(shadow[next]);
+				bytes += 3;
+			}else if(i != next) {
+				lcd_spi_transmit_CMD(lcd_line_addr[line] + i);	//init DDRAM addr-ctr
+				lcd_settle();
+				bytes += 3;
+			}
+			lcd_spi_transmit_DATA(lines[line][i]);
+			shadow[i] = lines[line][i];
+			bytes += 3;
+			next = i + 1;
+		}
 	}
+	lcd_frame_bytes = bytes;
+	return 1;
 }
 
 void clear_display(void){
-	lcd_spi_transmit_CMD(0x01);		//clear display
+	lcd_spi_transmit_CMD(0x01);		//clear display
+	lcd_delay(2);		//clearing takes 1.08ms
+	memset(lcd_shadow, ' ', sizeof(lcd_shadow));	//cleared DDRAM holds spaces
 }
\ No newline at end of file
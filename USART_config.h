@@ -13,6 +13,28 @@
 #define USART0_BAUD_RATE(BAUD_RATE) ((float)(F_CPU * 64 / (16 *(float)BAUD_RATE)) + 0.5)
 void USART0_init(void);
 int USART0_printChar(char character, FILE *stream);
+void USART0_tx_poll(void);
+uint8_t usart_tx_room(void);
+void USART0_rx_task(void);
+void execute_USART_command(char myCommand[]);
+void proto_receive(uint8_t *frame, uint8_t len);
+uint16_t usart_rx_overruns(void);
+
+//transmit ring buffer, filled by USART0_printChar and drained by the
+//data register empty interrupt
+#define USART_TX_SIZE 128		//must be a power of two
+#define USART_TX_DROP 0			//throw new bytes away when the buffer is full
+#define USART_TX_BLOCK 1		//wait for room when the buffer is full
+#ifndef USART_TX_FULL_POLICY
+#define USART_TX_FULL_POLICY USART_TX_BLOCK
+#endif
+
+//receive ring buffer, filled by the receive complete interrupt and drained
+//into command lines and binary request frames by USART0_rx_task in the
+//main loop
+#define USART_RX_SIZE 128		//must be a power of two
+#define USART_LINE_SIZE 50		//longest command line with the terminator, or
+								//request frame, see protocol.h
 
 #endif /* USART_CONFIG_H_ */
 
@@ -21,18 +43,33 @@ so it can be used in the USART_stream declaration*/
 int USART0_printChar(char character, FILE *stream);
 
 //setup a stream to print to USART, This will be used in place of stdout
-FILE USART_stream = FDEV_SETUP_STREAM(USART0_printChar, NULL, _FDEV_SETUP_WRITE);
+HAL_STDIO_STREAM(USART_stream, USART0_printChar);
+
+volatile char usart_tx_buf[USART_TX_SIZE];
+volatile uint8_t usart_tx_head = 0;		//next free slot
+volatile uint8_t usart_tx_tail = 0;		//next byte to send
+volatile uint16_t usart_tx_full = 0;	//number of writes that found the buffer full
+volatile uint16_t usart_tx_dropped = 0;	//number of bytes thrown away, USART_TX_DROP only
+
+volatile char usart_rx_buf[USART_RX_SIZE];
+volatile uint8_t usart_rx_head = 0;		//next free slot, written by the ISR only
+volatile uint8_t usart_rx_tail = 0;		//next byte to parse, written by the main loop only
+volatile uint16_t usart_rx_overrun = 0;	//number of bytes lost to a full buffer
+seq_t usart_rx_seq = 0;					//bumped by the ISR around usart_rx_overrun, see seqlock.h
 
 //variables for USART0 Reading
-char command[50];
+char command[USART_LINE_SIZE];
 uint8_t cmd_index = 0;
-char c;
+uint8_t cmd_too_long = 0;		//1 while the rest of an overlong line is thrown away
+uint8_t cmd_frame = 0;			//1 while a binary request frame is received
+uint8_t cmd_after_frame = 0;	//1 right after the 0x00 that ended a frame
+uint16_t usart_rx_long = 0;		//number of lines thrown away for being too long
 
 //***************************************************************************
 //
 // Function Name        : "USART0_init"
 // Date                 : 11/12/21
-// Version              : 1.0
+// Version              : 1.2
 // Target MCU           : AVR128DB48
 // Target Hardware      ; USART0 general output
 // Author               : Brandon Guzy
@@ -51,64 +88,158 @@ char c;
 // Revision History     : v1.0: Initial version
 //						  v1.1: Updated to enable receive complete interrupt
 //								and enable receive functionality
+//						  v1.2: Pins from board.h
 //
 //**************************************************************************
 void USART0_init(void)
 {
-	PORTA.DIR &= ~PIN1_bm;
-	PORTA.DIR |= PIN0_bm;
+	PORTA.DIR &= ~BOARD_USART_RX_A;
+	PORTA.DIR |= BOARD_USART_TX_A;
 	
 	USART0.BAUD = (uint16_t)USART0_BAUD_RATE(115200);
 	USART0.CTRLA |= USART_RXCIE_bm;
 	USART0.CTRLB |= USART_TXEN_bm;
 	USART0.CTRLB |= USART_RXEN_bm;	//enable receive
 	
-	stdout = &USART_stream;
+	stdout = HAL_STDIO_OPEN(USART_stream);
 }
 
 //***************************************************************************
 //
 // Function Name        : "USART0_RXC_vect Interrupt"
 // Date                 : 12/5/21
-// Version              : 1.0
+// Version              : 1.2
 // Target MCU           : AVR128DB48
 // Target Hardware      ; USART0 input
 // Author               : Brandon Guzy
 // DESCRIPTION
-// This runs every time data is received over USART. For this project, it is
-// character data. The character data is stored in a temporary string.
-// When the newline character is received, the string is presumed to be
-// complete, and the execute_USART_command function is run
+// This runs every time data is received over USART. The byte is put in the
+// receive ring buffer and USART0_rx_task puts the lines together later.
+// The time spent here is the same for every byte.
 //
-// Warnings             : none
-// Restrictions         : Requires global variables char[] command,  
-//						  int cmd_index, char c to be defined
-//							
-// Algorithms           : none
-// References           : execute_USART_command()
+// Warnings             : Bytes that arrive while the buffer is full are
+//						  lost and counted in usart_rx_overrun
+// Restrictions         : none
+// Algorithms           : Single producer, single consumer ring buffer. Each
+//						  side writes only its own index, so no locking
+// References           : USART0_rx_task()
 //
 // Revision History     : Initial version
+//						  v1.1 Buffered, lines run from the main loop
+//						  v1.2 usart_rx_seq around the overrun count
 //
 //**************************************************************************
 ISR(USART0_RXC_vect){
-	while (!(USART0.STATUS & USART_RXCIF_bm))//wait for data to be available
+	uint8_t c = hal_usart_read();
+	uint8_t next = (usart_rx_head + 1) & (USART_RX_SIZE - 1);
+	if(next == usart_rx_tail)
 	{
-		;
+		seq_write(&usart_rx_seq);
+		usart_rx_overrun++;
+		seq_write(&usart_rx_seq);
+		return;
 	}
-	c = USART0.RXDATAL;
-	if(c != '\n' && c != '\r')
+	usart_rx_buf[usart_rx_head] = c;
+	usart_rx_head = next;
+}
+
+//returns usart_rx_overrun, for the "link" command
+uint16_t usart_rx_overruns(void){
+	uint16_t overruns;
+	uint8_t start;
+	do {
+		start = seq_read_begin(&usart_rx_seq);
+		HAL_COPY(overruns, usart_rx_overrun);
+	} while(seq_read_retry(&usart_rx_seq, start));
+	return overruns;
+}
+
+//***************************************************************************
+//
+// Function Name        : "USART0_rx_task"
+// Date                 : 10/17/26
+// Version              : 1.2
+// Target MCU           : AVR128DB48
+// Target Hardware      ; none
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Called from the main loop. Takes the received bytes out of the ring
+// buffer and puts them together into a command line. When the newline
+// character is received, the line is complete and execute_USART_command is
+// run on it.
+// A 0x00 starts a binary request frame instead, which ends at the next
+// 0x00 and is passed to proto_receive. Text never contains a 0x00, so a
+// partly received line is dropped when a frame starts.
+// The 0x00 that ends a frame may also start the next one. The first byte
+// after it tells: a COBS code byte of a frame that fits the buffer is below
+// USART_LINE_SIZE, a text line starts with a letter.
+//
+// Warnings             : A line or frame longer than USART_LINE_SIZE - 1
+//						  bytes is thrown away whole and counted in
+//						  usart_rx_long
+// Restrictions         : Requires execute_USART_command and proto_receive
+//						  to be defined
+// Algorithms           : none
+// References           : execute_USART_command(), proto_receive()
+//
+// Revision History     : Initial version
+//						  v1.1 Binary request frames
+//						  v1.2 Back to back frames share a delimiter
+//
+//**************************************************************************
+void USART0_rx_task(void)
+{
+	char c;
+	while(usart_rx_tail != usart_rx_head)
 	{
-		command[cmd_index++] = c;
-		if(cmd_index > 50)
+		c = usart_rx_buf[usart_rx_tail];
+		usart_rx_tail = (usart_rx_tail + 1) & (USART_RX_SIZE - 1);
+		if(cmd_after_frame && c != 0x00)
 		{
+			cmd_after_frame = 0;
+			cmd_frame = (uint8_t)c < USART_LINE_SIZE;	//COBS code byte of the next frame
+		}
+		if(c == 0x00)
+		{
+			if(cmd_frame && cmd_index > 0)	//end of a frame
+			{
+				if(!cmd_too_long)
+				{
+					proto_receive((uint8_t *)command, cmd_index);
+				}
+				cmd_frame = 0;
+				cmd_after_frame = 1;
+			}
+			else	//start of a frame, or two delimiters in a row
+			{
+				cmd_frame = 1;
+				cmd_after_frame = 0;
+			}
 			cmd_index = 0;
+			cmd_too_long = 0;
+		}
+		else if(c == '\n' && !cmd_frame)
+		{
+			command[cmd_index] = '\0';
+			if(!cmd_too_long)
+			{
+				execute_USART_command(command);
+			}
+			cmd_index = 0;
+			cmd_too_long = 0;
+		}
+		else if(c != '\r' || cmd_frame)
+		{
+			if(cmd_index < USART_LINE_SIZE - 1)
+			{
+				command[cmd_index++] = c;
+			}
+			else if(!cmd_too_long)
+			{
+				cmd_too_long = 1;
+				usart_rx_long++;
+			}
 		}
-	}
-	if(c == '\n')
-	{
-		command[cmd_index] = '\0';
-		cmd_index = 0;
-		execute_USART_command(command);
 	}
 }
 
@@ -118,29 +249,98 @@ ISR(USART0_RXC_vect){
 //
 // Function Name        : "USART0_printChar"
 // Date                 : 11/12/21
-// Version              : 1.0
+// Version              : 1.1
 // Target MCU           : AVR128DB48
 // Target Hardware      ; USART general output
 // Author               : Brandon Guzy
 // DESCRIPTION
-// This prints out a character from a file stream to USART0
+// This puts a character from a file stream into the USART0 transmit buffer
+// and enables the data register empty interrupt, which sends it.
 // This will be used in conjunction with other code to print from stdout 
 // to USART
+// When the buffer is full the character is either dropped or the call waits
+// for room, depending on USART_TX_FULL_POLICY. usart_tx_full counts every
+// write that found the buffer full, usart_tx_dropped every dropped byte.
 //
 // Warnings             : none
-// Restrictions         : none
+// Restrictions         : Only one context may print at a time, the buffer
+//						  has a single producer
 // Algorithms           : none
-// References           : none
+// References           : USART0_tx_poll()
 //
 // Revision History     : Initial version
+//						  v1.1 Buffered, sent from the DRE interrupt
 //
-//**************************************************************************
+//**************************************************************************
 int USART0_printChar(char character, FILE *stream)
 {
+	uint8_t next = (usart_tx_head + 1) & (USART_TX_SIZE - 1);
+	if(next == usart_tx_tail) {
+		usart_tx_full++;
+#if USART_TX_FULL_POLICY == USART_TX_DROP
+		usart_tx_dropped++;
+		return 0;
+#else
+		while(next == usart_tx_tail) {
+			if(!(SREG & CPU_I_bm)) {	//DRE interrupt cannot run, send a byte by hand
+				USART0_tx_poll();
+			}
+			hal_idle();
+		}
+#endif
+	}
+	usart_tx_buf[usart_tx_head] = character;
+	usart_tx_head = next;
+	USART0.CTRLA |= USART_DREIE_bm;
+	return 0;
+}
+
+//returns the number of bytes that fit in the transmit buffer
+uint8_t usart_tx_room(void)
+{
+	return (usart_tx_tail - usart_tx_head - 1) & (USART_TX_SIZE - 1);
+}
+
+//sends the oldest buffered byte, waiting for the data register to empty
+void USART0_tx_poll(void)
+{
+	if(usart_tx_tail == usart_tx_head)
+		return;
 	while (!(USART0.STATUS & USART_DREIF_bm))
 	{
-		;
+		hal_idle();
 	}
-	USART0.TXDATAL = character;
-	return 0;
-}
\ No newline at end of file
+	hal_usart_write(usart_tx_buf[usart_tx_tail]);
+	usart_tx_tail = (usart_tx_tail + 1) & (USART_TX_SIZE - 1);
+}
+
+//***************************************************************************
+//
+// Function Name        : "USART0_DRE_vect Interrupt"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; USART0 output
+// Author               : Brandon Guzy
+// DESCRIPTION
+// This runs every time the USART0 data register is empty and sends the next
+// byte from the transmit buffer. The interrupt is turned off once the buffer
+// is empty and turned back on by USART0_printChar.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : USART0_printChar()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+ISR(USART0_DRE_vect){
+	if(usart_tx_tail == usart_tx_head)
+	{
+		USART0.CTRLA &= ~USART_DREIE_bm;	//nothing left to send
+		return;
+	}
+	hal_usart_write(usart_tx_buf[usart_tx_tail]);
+	usart_tx_tail = (usart_tx_tail + 1) & (USART_TX_SIZE - 1);
+}
@@ -0,0 +1,114 @@
+/*
+ * board.h
+ *
+ * Created: 10/18/2026 2:10:37 AM
+ *  Author: Brandon
+ */
+
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+//Pin assignments of the controller board, the one place that knows which
+//valve, button or analog input is on which pin. Each board revision is a
+//block below and BOARD_REV picks one at build time. Everything is a
+//constant, so the functions after the guard inline down to the same single
+//register accesses as the bare masks they replace. Valve SSRs may only sit
+//on PORTA or PORTD, their masks are given per port, see zone.h.
+#ifndef BOARD_REV
+#define BOARD_REV 1
+#endif
+
+#if BOARD_REV == 1
+//SSR enables, a set pin opens the valve
+#define BOARD_FILL_A PIN2_bm		//PA2, fill valve
+#define BOARD_FILL_D 0
+#define BOARD_CLEAN_A PIN3_bm		//PA3, clean valve
+#define BOARD_CLEAN_D 0
+#define BOARD_BB2_A 0
+#define BOARD_BB2_D PIN7_bm			//PD7, BB2 valve
+#define BOARD_ENAC_D PIN1_bm		//PD1, ENAC-, shared by every zone
+//push buttons, active low with the pull ups on
+#define BOARD_KEYS_PORT PORTC		//PC0-3, LCD buttons, key 0 first
+#define BOARD_KEYS_gm 0x0F
+#define BOARD_KEYS_gp 0
+#define BOARD_EXT_PORT PORTF		//PF0-1, external fill and clean buttons
+#define BOARD_EXT_gm 0x03
+#define BOARD_EXT_gp 0
+//analog inputs as ADC0 MUXPOS values, AINn is pin n of BOARD_AIN_PORT
+#define BOARD_AIN_PORT PORTD
+#define BOARD_AIN_SOLAR 0x03		//AIN3, solar panel
+#define BOARD_AIN_FILL 0x04			//AIN4, fill SSR sense
+#define BOARD_AIN_BB2 0x05			//AIN5, BB2 SSR sense
+#define BOARD_AIN_CLEAN 0x06		//AIN6, clean SSR sense
+//DOG204 LCD on SPI0, PA4 MOSI, PA6 SCK and PA7 chip select, which also
+//resets it
+#define BOARD_LCD_SPI_A (PIN4_bm | PIN6_bm | PIN7_bm)
+#define BOARD_LCD_CS_A PIN7_bm
+//PC0, the LCD RS line of the first board. It shares the pin with key 0 and
+//is never driven, the ST7036 gets RS in the SPI start byte.
+#define BOARD_LCD_RS_C PIN0_bm
+//USART0 to the host
+#define BOARD_USART_TX_A PIN0_bm	//PA0, TXD
+#define BOARD_USART_RX_A PIN1_bm	//PA1, RXD
+#else
+#error "Unknown BOARD_REV"
+#endif
+
+//the background scan in ADC_diagnostic.h steps through the inputs in a row
+#if BOARD_AIN_FILL != BOARD_AIN_SOLAR + 1 || BOARD_AIN_BB2 != BOARD_AIN_SOLAR + 2 \
+	|| BOARD_AIN_CLEAN != BOARD_AIN_SOLAR + 3
+#error "The analog inputs must be solar, fill, BB2 and clean on consecutive channels"
+#endif
+
+//every SSR of the board, for the POST and the diagnostics screen
+#define BOARD_SSR_A (BOARD_FILL_A | BOARD_CLEAN_A | BOARD_BB2_A)
+#define BOARD_SSR_D (BOARD_FILL_D | BOARD_CLEAN_D | BOARD_BB2_D | BOARD_ENAC_D)
+
+void board_pullups(PORT_t *port, uint8_t mask);
+void board_analog_input(uint8_t ain);
+
+#endif /* BOARD_H_ */
+
+//turns on the valve pins a of PORTA and d of PORTD, a mask that is 0 at
+//compile time costs nothing
+static inline void board_valves_on(uint8_t a, uint8_t d) {
+	if(a)
+		hal_port_set(&PORTA, a);
+	if(d)
+		hal_port_set(&PORTD, d);
+}
+
+//turns off the valve pins a of PORTA and d of PORTD
+static inline void board_valves_off(uint8_t a, uint8_t d) {
+	if(a)
+		hal_port_clear(&PORTA, a);
+	if(d)
+		hal_port_clear(&PORTD, d);
+}
+
+//LCD buttons held down, bit 0 is key 0
+static inline uint8_t board_keys_held(void) {
+	return (~BOARD_KEYS_PORT.IN & BOARD_KEYS_gm) >> BOARD_KEYS_gp;
+}
+
+//external buttons held down, bit 0 is fill and bit 1 clean
+static inline uint8_t board_ext_held(void) {
+	return (~BOARD_EXT_PORT.IN & BOARD_EXT_gm) >> BOARD_EXT_gp;
+}
+
+//makes the pins in mask inputs with their pull ups on, called once at boot
+void board_pullups(PORT_t *port, uint8_t mask) {
+	port->DIR &= ~mask;
+	for (uint8_t pin = 0; pin < 8; pin++) {
+		if(mask & (1 << pin))
+			(&port->PIN0CTRL)[pin] = PORT_PULLUPEN_bm;
+	}
+}
+
+//disables the interrupt and digital input buffer of the pin of analog
+//input ain
+void board_analog_input(uint8_t ain) {
+	volatile uint8_t *ctrl = &(&BOARD_AIN_PORT.PIN0CTRL)[ain];
+	*ctrl = (*ctrl & ~PORT_ISC_gm) | PORT_ISC_INPUT_DISABLE_gc;
+}
@@ -0,0 +1,81 @@
+/*
+ * boot.h
+ *
+ * Created: 10/17/2026 11:31:08 PM
+ *  Author: Vanessa
+ */
+
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+//Boot sequence. main() only does the setup that takes no time and enters
+//the main loop, which runs boot_task() every pass next to everything else.
+//The LCD init runs from its queue, so it overlaps with the pull ups
+//settling and the POST instead of each waiting in turn:
+//	BOOT_POST	every SSR is on until the ADC has scanned them, see
+//				post_poll(). Buttons and commands wait, received bytes
+//				stay in the USART ring. The pull ups get at least
+//				BOOT_PULLUP_TICKS to settle in this time.
+//	BOOT_SHOW	the system runs, the POST results stay on the LCD for
+//				BOOT_SHOW_S seconds, until an LCD button is pressed or
+//				until the home screen is left
+//	BOOT_DONE
+//boot_ready_ticks is the clock_ticks() at which commands were first taken,
+//counted from clock_init() at the top of main().
+#define BOOT_POST 0
+#define BOOT_SHOW 1
+#define BOOT_DONE 2
+#define BOOT_PULLUP_TICKS 52		//50 ms at CLOCK_HZ
+#define BOOT_SHOW_S 10
+
+uint8_t boot_stage = BOOT_POST;
+uint32_t boot_ready_ticks = 0;		//clock_ticks() when commands were first taken
+
+uint8_t boot_task(char mode);
+
+#endif /* BOOT_H_ */
+
+//***************************************************************************
+//
+// Function Name        : "boot_task"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; SSRs, ADC0
+// Author               : Vanessa Li
+// DESCRIPTION
+// Called from the main loop with the screen letter of the current state.
+// Moves the boot sequence on when its stage is over, see the top of
+// boot.h. Returns 1 once buttons and commands may be taken.
+//
+// Warnings             : none
+// Restrictions         : post_start() must have run before the first call
+// Algorithms           : none
+// References           : post_poll()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+uint8_t boot_task(char mode){
+	switch(boot_stage) {
+	case BOOT_POST:
+		if(clock_ticks() < BOOT_PULLUP_TICKS || !post_poll())
+			return 0;
+		//the ADC results are still the ones taken with the SSRs on
+		evlog_add(EVLOG_BOOT, EVLOG_CAUSE_NONE, mode);
+		evlog_add(EVLOG_POST, EVLOG_CAUSE_NONE, mode);
+		button_take_presses();		//drop anything seen while the pull ups settled
+		boot_ready_ticks = clock_ticks();
+		boot_stage = BOOT_SHOW;
+		lcd_dirty = 1;
+		break;
+	case BOOT_SHOW:
+		if(mode != 'h' || clock_ticks() - boot_ready_ticks >= (uint32_t)BOOT_SHOW_S * CLOCK_HZ) {
+			boot_stage = BOOT_DONE;
+			lcd_dirty = 1;
+		}
+		break;
+	}
+	return 1;
+}
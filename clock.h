@@ -0,0 +1,87 @@
+/*
+ * clock.h
+ *
+ * Created: 10/17/2026 7:15:40 PM
+ *  Author: Vanessa
+ */
+
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+//Monotonic time since reset. The RTC counts the internal 32.768 kHz
+//oscillator divided by 32 and overflows once a second, the overflow ISR
+//in main.c increments clock_seconds. It never goes backwards, schedules are
+//deadlines against it. RTC.CNT gives the fraction of the current second in
+//1/1024 s. The RTC keeps running in standby. The ISR bumps clock_seq around
+//the increment, the readers retry instead of turning interrupts off, see
+//seqlock.h.
+#define CLOCK_HZ 1024			//RTC counts per second
+
+volatile uint32_t clock_seconds = 0;	//whole seconds since reset, wraps after 136 years
+seq_t clock_seq = 0;
+
+void clock_init(void);
+uint32_t clock_now(void);
+uint32_t clock_ticks(void);
+
+#endif /* CLOCK_H_ */
+
+//***************************************************************************
+//
+// Function Name        : "clock_init"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; RTC
+// Author               : Vanessa Li
+// DESCRIPTION
+// Starts the RTC from the internal 32.768 kHz oscillator at 1024 Hz with an
+// overflow interrupt every second
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void clock_init(void){
+	RTC.CLKSEL = RTC_CLKSEL_OSC32K_gc;
+	while(RTC.STATUS)	//wait for the RTC registers to synchronize
+	{
+		hal_idle();
+	}
+	RTC.PER = CLOCK_HZ - 1;
+	RTC.INTCTRL = RTC_OVF_bm;
+	RTC.CTRLA = RTC_PRESCALER_DIV32_gc | RTC_RUNSTDBY_bm | RTC_RTCEN_bm;
+}
+
+//returns the whole seconds since reset
+uint32_t clock_now(void){
+	uint32_t now;
+	uint8_t start;
+	do {
+		start = seq_read_begin(&clock_seq);
+		HAL_COPY(now, clock_seconds);
+	} while(seq_read_retry(&clock_seq, start));
+	return now;
+}
+
+//returns the time since reset in 1/1024 s, wraps after 48 days
+uint32_t clock_ticks(void){
+	uint32_t seconds;
+	uint16_t count;
+	uint8_t start;
+	do {
+		start = seq_read_begin(&clock_seq);
+		HAL_COPY(seconds, clock_seconds);
+		count = RTC.CNT;
+		if(RTC.INTFLAGS & RTC_OVF_bm) {	//overflowed, the ISR has not run yet
+			seconds++;
+			count = RTC.CNT;
+		}
+	} while(seq_read_retry(&clock_seq, start));
+	return seconds * CLOCK_HZ + count;
+}
@@ -0,0 +1,276 @@
+/*
+ * config.h
+ *
+ * Created: 10/17/2026 9:26:03 PM
+ *  Author: Vanessa
+ */
+
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+//Settings kept in EEPROM across power cycles. The EEPROM is a ring of
+//records, each save goes into the slot after the newest one so the writes
+//are spread over the whole EEPROM. A record holds the settings of one zone,
+//see zone.h, and night_mode:
+//	byte 0		CONFIG_VERSION
+//	byte 1		sequence number, one more than the record before it
+//	byte 2		zone in bits 7-5, clean_time in hours in bits 4-0
+//	byte 3-4	topOff_fill_delay in milliseconds, little endian
+//	byte 5		night_mode
+//	byte 6-7	CRC-16/XMODEM of bytes 0-5, little endian
+//The newest record is the valid one whose next slot does not hold the next
+//sequence number. The settings of a zone come from its newest record,
+//found by going back from the newest record while the sequence numbers
+//follow on, night_mode comes from the newest record. Before the ring comes
+//round to the newest record of a zone, config_task writes that zone again.
+//A record cut short by a power loss fails its CRC, so the one before it is
+//used. Bump CONFIG_VERSION when the layout changes, older
+//records are then ignored and the defaults used, unless config_load knows
+//the old layout. Version 1 records had clean_time in seconds in bytes 2-3
+//and topOff_fill_delay in seconds in byte 4, and were all zone 0.
+//config_task writes one byte per main loop pass whenever the EEPROM is not
+//busy, nothing ever waits for the EEPROM.
+
+//EEPROM map. The config ring starts at 0 and takes all of the EEPROM, or
+//the lower half when the event log is kept in EEPROM as well. Changing
+//EVLOG_EEPROM moves the ring, the settings may fall back to an older record.
+#ifndef EVLOG_EEPROM
+#define EVLOG_EEPROM 0
+#endif
+#if EVLOG_EEPROM
+#define CONFIG_EEPROM_SIZE (EEPROM_SIZE / 2)
+#else
+#define CONFIG_EEPROM_SIZE EEPROM_SIZE
+#endif
+#define EVLOG_EEPROM_START CONFIG_EEPROM_SIZE
+#define EVLOG_EEPROM_SIZE (EEPROM_SIZE - CONFIG_EEPROM_SIZE)
+#define CONFIG_VERSION 2
+#define CONFIG_VERSION_V1 1			//older layout config_load still reads
+#define CONFIG_V1_TOPOFF_MAX_S 65	//longest version 1 top off that fits the ms field
+#define CONFIG_RECORD_SIZE 8
+#define CONFIG_SLOTS (CONFIG_EEPROM_SIZE / CONFIG_RECORD_SIZE)
+#define CONFIG_SETTLE_S 3			//settings must stay unchanged this long before a save
+
+typedef struct {
+	uint16_t clean_time[ZONES];
+	uint16_t topOff_fill_delay[ZONES];
+	uint8_t night_mode;
+} config_t;
+
+config_t config_saved;				//settings in the newest record
+config_t config_seen;				//settings at the last config_task pass
+uint32_t config_seen_at = 0;		//clock_seconds when config_seen last changed
+uint8_t config_slot = CONFIG_SLOTS - 1;	//slot of the newest record
+uint8_t config_seq = 0xFF;			//sequence number of the newest record
+uint8_t config_record[CONFIG_RECORD_SIZE];	//record being written
+uint8_t config_written = CONFIG_RECORD_SIZE;	//bytes of config_record in EEPROM
+uint16_t config_saves = 0;			//number of records written since reset
+uint8_t config_zone_seq[ZONES];		//sequence number of the newest record of each zone
+uint8_t config_zone_saved = 0;		//bit per zone that has a record
+
+uint8_t config_load(config_t *config);
+void config_task(const config_t *config, uint32_t now);
+
+#endif /* CONFIG_H_ */
+
+//reads the record in a slot, returns 1 if it is valid
+uint8_t config_read_slot(uint8_t slot, uint8_t *record){
+	uint16_t crc = 0;
+	for (uint8_t i = 0; i < CONFIG_RECORD_SIZE; i++) {
+		record[i] = hal_eeprom_read(slot * CONFIG_RECORD_SIZE + i);
+	}
+	for (uint8_t i = 0; i < CONFIG_RECORD_SIZE - 2; i++) {
+		crc = _crc_xmodem_update(crc, record[i]);
+	}
+	return (record[0] == CONFIG_VERSION || record[0] == CONFIG_VERSION_V1)
+		&& crc == (record[CONFIG_RECORD_SIZE - 2] | ((uint16_t)record[CONFIG_RECORD_SIZE - 1] << 8));
+}
+
+//copies the settings in a record into config, unless its zone is one of
+//the found bits already. Returns the bit of the zone it copied, 0 if none.
+uint8_t config_decode(const uint8_t *record, config_t *config, uint8_t found){
+	uint8_t zone = 0;
+	uint16_t clean_at;
+	uint16_t topoff;
+	if(record[0] == CONFIG_VERSION_V1) {
+		clean_at = record[2] | ((uint16_t)record[3] << 8);
+		//clamped, 66 s and up would wrap past 65535 ms
+		topoff = ((record[4] > CONFIG_V1_TOPOFF_MAX_S) ? CONFIG_V1_TOPOFF_MAX_S : record[4]) * 1000U;
+	}else {
+		zone = record[2] >> 5;
+		clean_at = (record[2] & 0x1F) * 3600U;
+		topoff = record[3] | ((uint16_t)record[4] << 8);
+	}
+	if(zone >= ZONES || (found & (1 << zone)))
+		return 0;
+	config->clean_time[zone] = clean_at;
+	config->topOff_fill_delay[zone] = topoff;
+	config_zone_seq[zone] = record[1];
+	return 1 << zone;
+}
+
+//returns the first zone whose settings differ between a and b, ZONES if
+//none do. A different night_mode counts as a change of zone 0.
+uint8_t config_changed_zone(const config_t *a, const config_t *b){
+	uint8_t zone;
+	if(a->night_mode != b->night_mode)
+		return 0;
+	for (zone = 0; zone < ZONES; zone++) {
+		if(a->clean_time[zone] != b->clean_time[zone]
+			|| a->topOff_fill_delay[zone] != b->topOff_fill_delay[zone])
+			break;
+	}
+	return zone;
+}
+
+//returns a zone whose newest record the ring is about to overwrite, ZONES
+//if there is none
+uint8_t config_stale_zone(void){
+	uint8_t zone;
+	for (zone = 0; zone < ZONES; zone++) {
+		if((config_zone_saved & (1 << zone))
+			&& (uint8_t)(config_seq - config_zone_seq[zone]) >= CONFIG_SLOTS - ZONES)
+			break;
+	}
+	return zone;
+}
+
+//***************************************************************************
+//
+// Function Name        : "config_load"
+// Date                 : 10/17/26
+// Version              : 1.2
+// Target MCU           : AVR128DB48
+// Target Hardware      ; EEPROM
+// Author               : Vanessa Li
+// DESCRIPTION
+// Finds the newest record in the EEPROM ring and copies the settings of
+// every zone into config, converting version 1 records. Returns 1 if there
+// was one, 0 if the EEPROM holds no valid record and config was left
+// alone. Zones without a record keep what config held. Later saves go into
+// the slot after the newest, and only once the settings differ from what
+// config holds now.
+//
+// Warnings             : The values are not range checked here
+// Restrictions         : Call once at boot, before config_task
+// Algorithms           : none
+// References           : config_task()
+//
+// Revision History     : Initial version
+//						  v1.1 Reads version 2 records, top off in ms
+//						  v1.2 A record per zone
+//
+//**************************************************************************
+uint8_t config_load(config_t *config){
+	uint8_t record[CONFIG_RECORD_SIZE];
+	uint8_t next[CONFIG_RECORD_SIZE];
+	uint8_t found = 0;
+	uint8_t valid = config_read_slot(0, next);
+	uint8_t first_valid = valid;
+	for (uint8_t slot = 0; slot < CONFIG_SLOTS; slot++) {
+		uint8_t this_valid = valid;
+		for (uint8_t i = 0; i < CONFIG_RECORD_SIZE; i++) {
+			record[i] = next[i];
+		}
+		if(slot + 1 < CONFIG_SLOTS) {
+			valid = config_read_slot(slot + 1, next);
+		}else {		//the ring wraps around to slot 0
+			valid = first_valid;
+			config_read_slot(0, next);
+		}
+		if(this_valid && !(valid && next[1] == (uint8_t)(record[1] + 1))) {
+			config_slot = slot;
+			config_seq = record[1];
+			config->night_mode = record[5];
+			//the records before it, while the sequence numbers follow on
+			for (uint8_t back = 0; back < CONFIG_SLOTS && found != (1 << ZONES) - 1; back++) {
+				if(back && !(config_read_slot((slot + CONFIG_SLOTS - back) % CONFIG_SLOTS, record)
+					&& record[1] == (uint8_t)(config_seq - back)))
+					break;
+				found |= config_decode(record, config, found);
+			}
+			config_zone_saved = found;
+			config_saved = *config;
+			config_seen = *config;
+			return 1;
+		}
+	}
+	config_saved = *config;		//nothing to save until the defaults change
+	config_seen = *config;
+	return 0;
+}
+
+//***************************************************************************
+//
+// Function Name        : "config_task"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; EEPROM
+// Author               : Vanessa Li
+// DESCRIPTION
+// Called from the main loop with the current settings and clock_seconds.
+// Once the settings differ from what the EEPROM holds and have not changed
+// for CONFIG_SETTLE_S seconds, a new record is started in the next slot for
+// the first zone that changed. The record goes out one byte per call, only
+// when the EEPROM is not busy. Other changed zones follow in the records
+// after it. A zone whose record the ring would overwrite next is written
+// again.
+//
+// Warnings             : none
+// Restrictions         : Settings changed while a record is written are
+//						  saved in the record after it
+// Algorithms           : Wear leveling ring, see the top of config.h
+// References           : config_load()
+//
+// Revision History     : Initial version
+//						  v1.1 A record per zone
+//
+//**************************************************************************
+void config_task(const config_t *config, uint32_t now){
+	uint16_t crc = 0;
+	uint8_t zone;
+	if(config_written < CONFIG_RECORD_SIZE) {
+		if(!hal_eeprom_busy()) {
+			hal_eeprom_write(config_slot * CONFIG_RECORD_SIZE + config_written,
+				config_record[config_written]);
+			config_written++;
+		}
+		return;
+	}
+	if(config_changed_zone(config, &config_seen) < ZONES) {
+		config_seen = *config;		//still being changed, wait for it to settle
+		config_seen_at = now;
+		return;
+	}
+	zone = config_changed_zone(config, &config_saved);
+	if(zone < ZONES && now - config_seen_at < CONFIG_SETTLE_S) {
+		return;
+	}
+	if(zone == ZONES) {
+		zone = config_stale_zone();
+		if(zone == ZONES)
+			return;
+	}
+	config_saved.clean_time[zone] = config->clean_time[zone];
+	config_saved.topOff_fill_delay[zone] = config->topOff_fill_delay[zone];
+	config_saved.night_mode = config->night_mode;
+	config_slot = (config_slot + 1) % CONFIG_SLOTS;
+	config_seq++;
+	config_record[0] = CONFIG_VERSION;
+	config_record[1] = config_seq;
+	config_record[2] = (zone << 5) | (config->clean_time[zone] / 3600);
+	config_record[3] = config->topOff_fill_delay[zone] & 0xFF;
+	config_record[4] = config->topOff_fill_delay[zone] >> 8;
+	config_record[5] = config->night_mode;
+	config_zone_seq[zone] = config_seq;
+	config_zone_saved |= 1 << zone;
+	for (uint8_t i = 0; i < CONFIG_RECORD_SIZE - 2; i++) {
+		crc = _crc_xmodem_update(crc, config_record[i]);
+	}
+	config_record[CONFIG_RECORD_SIZE - 2] = crc & 0xFF;
+	config_record[CONFIG_RECORD_SIZE - 1] = crc >> 8;
+	config_written = 0;
+	config_saves++;
+}
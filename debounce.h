@@ -0,0 +1,106 @@
+/*
+ * debounce.h
+ *
+ * Created: 10/17/2026 10:02:17 AM
+ *  Author: Vanessa
+ */ 
+
+
+#ifndef DEBOUNCE_H_
+#define DEBOUNCE_H_
+
+//The LCD buttons and the external buttons, see board.h, are sampled
+//every 5ms by TCB1. A button has to read the same for 4 samples in a row
+//before its debounced state changes, and each new press is latched in
+//button_press until the main loop takes it with button_take_presses().
+//Bit layout of the button masks:
+#define BUTTON_LCD_gm 0x0F		//LCD buttons, key 0 first
+#define BUTTON_EXT_gm 0x30		//external buttons, fill first
+#define BUTTON_EXT_gp 4
+#define DEBOUNCE_TICKS 9999		//5ms at F_CPU/2, the period is CCMP + 1
+
+volatile uint8_t button_press = 0;	//presses not yet taken by the main loop
+volatile uint8_t ui_ticks = 0;		//counts the 5ms samples, wraps
+uint8_t button_state = 0;			//debounced state, 1 = held down
+uint8_t button_ct0 = 0xFF;			//vertical counter, low bits
+uint8_t button_ct1 = 0xFF;			//vertical counter, high bits
+
+void debounce_init(void);
+uint8_t button_take_presses(void);
+
+#endif /* DEBOUNCE_H_ */
+
+//***************************************************************************
+//
+// Function Name        : "debounce_init"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; Push Button
+// Author               : Vanessa Li
+// DESCRIPTION
+// Starts TCB1 as the 5ms sample tick for the button debouncer
+//
+// Warnings             : none
+// Restrictions         : The button pins must be set up as inputs with
+//						  pull ups, see port_init()
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void debounce_init(void){
+	TCB1.CCMP = DEBOUNCE_TICKS;
+	TCB1.CTRLB = TCB_CNTMODE_INT_gc;	//periodic interrupt mode
+	TCB1.INTCTRL = TCB_CAPT_bm;
+	TCB1.CTRLA = TCB_CLKSEL_DIV2_gc | TCB_ENABLE_bm;
+}
+
+//***************************************************************************
+//
+// Function Name        : "TCB1 ISR"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; Push Button
+// Author               : Vanessa Li
+// DESCRIPTION
+// Samples all six buttons at once and runs them through a 2 bit vertical
+// counter per button. Every bit that has differed from the debounced state
+// for 4 samples flips, and flips to pressed are latched in button_press.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : Vertical counter debounce
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+ISR(TCB1_INT_vect){
+	PROF_BEGIN(PROF_DEBOUNCE);
+	uint8_t changed;
+	uint8_t held = board_keys_held() | (board_ext_held() << BUTTON_EXT_gp);
+	
+	changed = button_state ^ held;
+	button_ct0 = ~(button_ct0 & changed);	//counters count while changed, reset otherwise
+	button_ct1 = button_ct0 ^ (button_ct1 & changed);
+	changed &= button_ct0 & button_ct1;		//counter rolled over
+	button_state ^= changed;
+	button_press |= button_state & changed;
+	ui_ticks++;
+	
+	TCB1.INTFLAGS = TCB_CAPT_bm;	//clear interrupt flag
+	PROF_END(PROF_DEBOUNCE);
+}
+
+//returns the presses since the last call and clears them
+uint8_t button_take_presses(void){
+	uint8_t presses;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		presses = button_press;
+		button_press = 0;
+	}
+	return presses;
+}
@@ -0,0 +1,337 @@
+/*
+ * eventlog.h
+ *
+ * Created: 10/17/2026 10:05:47 PM
+ *  Author: Vanessa
+ */
+
+
+#ifndef EVENTLOG_H_
+#define EVENTLOG_H_
+
+//Ring log of what the controller did, kept in SRAM. Every entry gets the
+//next sequence number, the oldest entries are overwritten once the ring is
+//full. Packed, an entry is
+//	byte 0-3	clock_seconds, little endian
+//	byte 4-5	sequence number, little endian
+//	byte 6		EVLOG_* kind
+//	byte 7		EVLOG_CAUSE_* in bits 0-3, zone in bits 4-6
+//	byte 8		mode
+//	byte 9-12	solar panel, fill, BB2 and clean SSR sense, 16 mV units
+//The "log" USART command or PROTO_OP_LOG dumps it from the main loop, a few
+//entries per pass and only while the transmit buffer has room, so nothing
+//waits on USART0. In binary telemetry each pass sends one frame:
+//	byte 0		EVLOG_FRAME_CHUNK
+//	byte 1		dump number, increments every dump
+//	byte 2		chunk number, from 0
+//	byte 3		number of chunks in the dump
+//	byte 4-		up to EVLOG_CHUNK_ENTRIES packed entries, oldest first
+//With "telem text" each pass sends one entry as a text line instead, and
+//"log end" after the last one.
+//Built with EVLOG_EEPROM=1 the entries are also copied to the EEPROM area
+//config.h leaves for the log, with a CRC-16/XMODEM in bytes 13-14, and
+//read back at boot so the log survives a power cycle. EVLOG_EE_SLOTS must
+//not be above EVLOG_SIZE.
+#define EVLOG_SIZE 32					//entries in SRAM, must be a power of two
+#define EVLOG_ENTRY_SIZE 13				//packed entry
+#define EVLOG_EE_ENTRY_SIZE 16			//packed entry, CRC and a spare byte
+#define EVLOG_EE_SLOTS (EVLOG_EEPROM_SIZE / EVLOG_EE_ENTRY_SIZE)
+#define EVLOG_FRAME_CHUNK 0x04
+#define EVLOG_CHUNK_HEAD 4
+#define EVLOG_CHUNK_ENTRIES 4
+#define EVLOG_TX_ROOM 80				//transmit buffer room a dump pass needs
+
+//kinds
+#define EVLOG_BOOT 1				//reset, logged with the POST once commands are taken
+#define EVLOG_POST 2				//power-on self-test, the sense is its result
+#define EVLOG_FILL_START 3
+#define EVLOG_FILL_DONE 4
+#define EVLOG_FILL_CANCEL 5
+#define EVLOG_CLEAN_START 6
+#define EVLOG_CLEAN_DONE 7
+#define EVLOG_CLEAN_CANCEL 8
+#define EVLOG_DISABLE 9
+#define EVLOG_ENABLE 10
+#define EVLOG_NIGHT_START 11		//dark, night mode screen
+#define EVLOG_NIGHT_END 12
+#define EVLOG_NIGHT_MODE_ON 13		//night mode setting
+#define EVLOG_NIGHT_MODE_OFF 14
+
+//causes
+#define EVLOG_CAUSE_NONE 0
+#define EVLOG_CAUSE_BUTTON 1		//LCD or external button
+#define EVLOG_CAUSE_USART 2			//text command or binary request
+#define EVLOG_CAUSE_SCHEDULE 3
+#define EVLOG_CAUSE_TIMER 4			//fill or clean time was up
+#define EVLOG_CAUSE_SOLAR 5			//solar panel went dark or light
+
+typedef struct {
+	uint32_t time;
+	uint16_t seq;
+	uint8_t kind;
+	uint8_t cause;
+	char mode;
+	uint8_t sense[4];
+} evlog_entry_t;
+
+evlog_entry_t evlog[EVLOG_SIZE];		//entry seq is at evlog[seq % EVLOG_SIZE]
+uint16_t evlog_seq = 0;					//sequence number of the next entry
+uint8_t evlog_count = 0;				//entries in the ring
+uint8_t evlog_dumps = 0;				//dumps started
+uint16_t evlog_dump_next = 0;			//next entry to dump
+uint8_t evlog_dump_left = 0;			//entries left to dump, 0 when idle
+uint8_t evlog_dump_chunk = 0;
+uint8_t evlog_dump_chunks = 0;
+#if EVLOG_EEPROM
+uint16_t evlog_flushed = 0;				//entries below this are in EEPROM
+uint8_t evlog_ee_record[EVLOG_EE_ENTRY_SIZE];	//entry being written
+uint8_t evlog_ee_written = EVLOG_EE_ENTRY_SIZE;	//bytes of it in EEPROM
+#endif
+
+void evlog_init(void);
+void evlog_add(uint8_t kind, uint8_t cause, char mode);
+void evlog_dump(void);
+void evlog_task(void);
+
+#endif /* EVENTLOG_H_ */
+
+//packs an entry into EVLOG_ENTRY_SIZE bytes
+void evlog_pack(const evlog_entry_t *entry, uint8_t *out){
+	out[0] = entry->time & 0xFF;
+	out[1] = (entry->time >> 8) & 0xFF;
+	out[2] = (entry->time >> 16) & 0xFF;
+	out[3] = entry->time >> 24;
+	out[4] = entry->seq & 0xFF;
+	out[5] = entry->seq >> 8;
+	out[6] = entry->kind;
+	out[7] = entry->cause;
+	out[8] = entry->mode;
+	for (uint8_t i = 0; i < 4; i++) {
+		out[9 + i] = entry->sense[i];
+	}
+}
+
+//***************************************************************************
+//
+// Function Name        : "evlog_add"
+// Date                 : 10/17/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ADC0
+// Author               : Vanessa Li
+// DESCRIPTION
+// Adds an entry of kind and cause with the time, mode, zone_cur and the
+// latest background ADC results to the log, overwriting the oldest entry
+// when the ring is full.
+//
+// Warnings             : none
+// Restrictions         : Main loop only, the ring is not shared with ISRs
+// Algorithms           : none
+// References           : ADCpinSel_and_output()
+//
+// Revision History     : Initial version
+//						  v1.1 Zone
+//
+//**************************************************************************
+void evlog_add(uint8_t kind, uint8_t cause, char mode){
+	evlog_entry_t *entry = &evlog[evlog_seq & (EVLOG_SIZE - 1)];
+	uint16_t mv;
+	entry->time = clock_now();
+	entry->seq = evlog_seq++;
+	entry->kind = kind;
+	entry->cause = cause | (zone_cur << 4);
+	entry->mode = mode;
+	for (uint8_t i = 0; i < 4; i++) {
+		mv = ADCpinSel_and_output(ADC_FIRST_CHANNEL + i) >> 4;
+		entry->sense[i] = (mv > 0xFF) ? 0xFF : mv;
+	}
+	if(evlog_count < EVLOG_SIZE)
+		evlog_count++;
+}
+
+//starts a dump of every entry in the log, restarts one that is running
+void evlog_dump(void){
+	evlog_dump_left = evlog_count;
+	evlog_dump_next = evlog_seq - evlog_count;
+	evlog_dump_chunk = 0;
+	evlog_dump_chunks = (evlog_count + EVLOG_CHUNK_ENTRIES - 1) / EVLOG_CHUNK_ENTRIES;
+	if(evlog_dump_chunks == 0)
+		evlog_dump_chunks = 1;		//an empty log is one empty chunk
+	evlog_dumps++;
+}
+
+//sends the next chunk of a running dump, returns 0 when there is none
+uint8_t evlog_dump_task(void){
+	uint8_t frame[EVLOG_CHUNK_HEAD + EVLOG_CHUNK_ENTRIES * EVLOG_ENTRY_SIZE];
+	uint8_t len = EVLOG_CHUNK_HEAD;
+	const evlog_entry_t *entry;
+	if(evlog_dump_chunk >= evlog_dump_chunks)
+		return 0;
+	if(usart_tx_room() < EVLOG_TX_ROOM)
+		return 0;	//wait for USART0 to catch up
+	//entries the ring overwrote since the dump started are gone
+	if((uint16_t)(evlog_seq - evlog_dump_next) > evlog_count) {
+		uint16_t lost = (uint16_t)(evlog_seq - evlog_dump_next) - evlog_count;
+		evlog_dump_next += lost;
+		evlog_dump_left = (lost < evlog_dump_left) ? evlog_dump_left - lost : 0;
+	}
+	if(telemetry_text) {
+		if(evlog_dump_left) {
+			entry = &evlog[evlog_dump_next++ & (EVLOG_SIZE - 1)];
+			evlog_dump_left--;
+			printf("log %u t=%lu kind=%u cause=%u zone=%u mode=%c sense=%u,%u,%u,%u\n",
+				entry->seq, (unsigned long)entry->time, entry->kind, entry->cause & 0x0F,
+				(entry->cause >> 4) + 1, entry->mode, entry->sense[0] << 4, entry->sense[1] << 4,
+				entry->sense[2] << 4, entry->sense[3] << 4);
+		}
+		if(!evlog_dump_left) {
+			printf("log end\n");
+			evlog_dump_chunk = evlog_dump_chunks;
+		}
+		return 1;
+	}
+	frame[0] = EVLOG_FRAME_CHUNK;
+	frame[1] = evlog_dumps;
+	frame[2] = evlog_dump_chunk;
+	frame[3] = evlog_dump_chunks;
+	for (uint8_t i = 0; i < EVLOG_CHUNK_ENTRIES && evlog_dump_left; i++) {
+		evlog_pack(&evlog[evlog_dump_next++ & (EVLOG_SIZE - 1)], &frame[len]);
+		len += EVLOG_ENTRY_SIZE;
+		evlog_dump_left--;
+	}
+	telemetry_send_frame(frame, len);
+	if(++evlog_dump_chunk == evlog_dump_chunks)
+		evlog_dump_left = 0;	//entries added since the dump started wait for the next one
+	return 1;
+}
+
+#if EVLOG_EEPROM
+//reads the entry in an EEPROM slot, returns 1 if it is valid
+uint8_t evlog_ee_read(uint8_t slot, evlog_entry_t *entry){
+	uint8_t record[EVLOG_EE_ENTRY_SIZE];
+	uint16_t crc = 0;
+	for (uint8_t i = 0; i < EVLOG_EE_ENTRY_SIZE; i++) {
+		record[i] = hal_eeprom_read(EVLOG_EEPROM_START + slot * EVLOG_EE_ENTRY_SIZE + i);
+	}
+	for (uint8_t i = 0; i < EVLOG_ENTRY_SIZE; i++) {
+		crc = _crc_xmodem_update(crc, record[i]);
+	}
+	if(crc != (record[EVLOG_ENTRY_SIZE] | (record[EVLOG_ENTRY_SIZE + 1] << 8)))
+		return 0;
+	entry->time = record[0] | ((uint32_t)record[1] << 8)
+		| ((uint32_t)record[2] << 16) | ((uint32_t)record[3] << 24);
+	entry->seq = record[4] | (record[5] << 8);
+	entry->kind = record[6];
+	entry->cause = record[7];
+	entry->mode = record[8];
+	for (uint8_t i = 0; i < 4; i++) {
+		entry->sense[i] = record[9 + i];
+	}
+	return 1;
+}
+#endif
+
+//***************************************************************************
+//
+// Function Name        : "evlog_init"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; EEPROM
+// Author               : Vanessa Li
+// DESCRIPTION
+// With EVLOG_EEPROM, reads the entries saved before the last reset back
+// into the log, oldest first, and carries on their sequence numbers.
+// Entry seq is kept in EEPROM slot seq % EVLOG_EE_SLOTS, the newest is the
+// valid one whose next slot does not hold seq + 1. Does nothing otherwise.
+//
+// Warnings             : none
+// Restrictions         : Call once at boot, before anything is logged
+// Algorithms           : none
+// References           : evlog_task()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void evlog_init(void){
+#if EVLOG_EEPROM
+	evlog_entry_t entry;
+	evlog_entry_t next;
+	uint8_t newest = 0xFF;
+	uint8_t slot;
+	for (slot = 0; slot < EVLOG_EE_SLOTS && newest == 0xFF; slot++) {
+		if(evlog_ee_read(slot, &entry) && (entry.seq % EVLOG_EE_SLOTS) == slot
+			&& !(evlog_ee_read((slot + 1) % EVLOG_EE_SLOTS, &next) && next.seq == (uint16_t)(entry.seq + 1))) {
+			newest = slot;
+		}
+	}
+	if(newest == 0xFF)
+		return;
+	//walk back to the oldest entry of the run that ends at the newest
+	slot = newest;
+	evlog_ee_read(newest, &entry);
+	evlog_seq = entry.seq + 1;
+	for (uint8_t i = 1; i < EVLOG_EE_SLOTS; i++) {
+		uint8_t prev = (slot + EVLOG_EE_SLOTS - 1) % EVLOG_EE_SLOTS;
+		if(!evlog_ee_read(prev, &next) || next.seq != (uint16_t)(entry.seq - 1))
+			break;
+		entry = next;
+		slot = prev;
+	}
+	evlog_count = evlog_seq - entry.seq;
+	for (uint16_t seq = entry.seq; seq != evlog_seq; seq++) {
+		evlog_ee_read(seq % EVLOG_EE_SLOTS, &evlog[seq & (EVLOG_SIZE - 1)]);
+	}
+	evlog_flushed = evlog_seq;
+#endif
+}
+
+//***************************************************************************
+//
+// Function Name        : "evlog_task"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; USART0 output, EEPROM
+// Author               : Vanessa Li
+// DESCRIPTION
+// Called from the main loop. Sends the next chunk of a running dump, and
+// with EVLOG_EEPROM writes one byte of the oldest entry not yet in EEPROM
+// when the EEPROM is not busy.
+//
+// Warnings             : Entries overwritten in SRAM before they reached
+//						  EEPROM are skipped
+// Restrictions         : none
+// Algorithms           : none
+// References           : evlog_dump_task(), evlog_init()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void evlog_task(void){
+	evlog_dump_task();
+#if EVLOG_EEPROM
+	uint16_t crc = 0;
+	if(evlog_ee_written < EVLOG_EE_ENTRY_SIZE) {
+		if(!hal_eeprom_busy()) {
+			hal_eeprom_write(EVLOG_EEPROM_START + (evlog_flushed % EVLOG_EE_SLOTS) * EVLOG_EE_ENTRY_SIZE
+				+ evlog_ee_written, evlog_ee_record[evlog_ee_written]);
+			if(++evlog_ee_written == EVLOG_EE_ENTRY_SIZE)
+				evlog_flushed++;
+		}
+		return;
+	}
+	if(evlog_flushed == evlog_seq)
+		return;
+	if((uint16_t)(evlog_seq - evlog_flushed) > evlog_count)
+		evlog_flushed = evlog_seq - evlog_count;
+	evlog_pack(&evlog[evlog_flushed & (EVLOG_SIZE - 1)], evlog_ee_record);
+	for (uint8_t i = 0; i < EVLOG_ENTRY_SIZE; i++) {
+		crc = _crc_xmodem_update(crc, evlog_ee_record[i]);
+	}
+	evlog_ee_record[EVLOG_ENTRY_SIZE] = crc & 0xFF;
+	evlog_ee_record[EVLOG_ENTRY_SIZE + 1] = crc >> 8;
+	evlog_ee_record[EVLOG_ENTRY_SIZE + 2] = 0xFF;
+	evlog_ee_written = 0;
+#endif
+}
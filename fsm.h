@@ -0,0 +1,221 @@
+/*
+ * fsm.h
+ *
+ * Created: 10/17/2026 3:12:08 PM
+ *  Author: Vanessa
+ */
+
+
+#ifndef FSM_H_
+#define FSM_H_
+
+#include <stdint.h>
+
+//The transition table is plain data so it can be compiled on the host as
+//well and every (state, event) pair checked from there. On the AVR it is
+//kept in flash. Every zone runs its own copy of the state machine, see
+//zone.h, with the same table.
+#if defined(__AVR__) || defined(HAL_HOST)
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+
+//transition targets below FSM_FIRST_STATE are not states
+#define FSM_STAY 0			//internal transition, no exit or entry actions
+#define FSM_BACK 1			//back to disabled or home, whichever was left
+
+//states, the letter is the screen each one shows
+#define ST_HOME 2			//'h' home screen
+#define ST_MODE 3			//'m' mode menu
+#define ST_DISABLE_ASK 4	//'e' disable system?
+#define ST_DISABLED 5		//'d' system disabled
+#define ST_NIGHT_ASK 6		//'n' turn night mode on/off?
+#define ST_CLEAN_SET 7		//'l' fills per clean
+#define ST_FILL_SET 8		//'i' top off fill duration
+#define ST_FILLING 9		//'f' fill running
+#define ST_CLEANING 10		//'c' clean running
+#define ST_DIAG 11			//'a' diagnostics
+#define ST_NIGHT 12			//'g' night mode
+#define FSM_FIRST_STATE ST_HOME
+#define FSM_STATES 11
+
+//events
+#define EV_KEY0 0			//PC0, the LCD buttons from left to right
+#define EV_KEY1 1			//PC1
+#define EV_KEY2 2			//PC2
+#define EV_KEY3 3			//PC3
+#define EV_KEY_MULTI 4		//several LCD buttons in the same tick
+#define EV_EXT_CLEAN 5		//external clean button, PF1
+#define EV_EXT_FILL 6		//external fill button, PF0
+#define EV_SCHED_FILL 7		//scheduled fill came due
+#define EV_SCHED_CLEAN 8	//scheduled clean came due
+#define EV_CMD_FILL 9		//USART "fill"
+#define EV_CMD_CLEAN 10		//USART "clean"
+#define EV_CMD_DISABLE 11	//USART "disable"
+#define EV_CMD_CANCEL 12	//USART "cancel"
+#define EV_TIMEOUT 13		//fill or clean time is up
+#define EV_DARK 14			//solar panel says night, night mode on
+#define EV_LIGHT 15			//solar panel says day
+#define FSM_EVENTS 16
+#define EV_NONE 0xFF
+
+//transition, entry and exit actions, index into fsm_actions[] in main.c
+#define ACT_NONE 0
+#define ACT_NIGHT_TOGGLE 1	//flip night mode
+#define ACT_NIGHT_OFF 2		//night mode off
+#define ACT_CLEAN_MORE 3	//one more fill per clean
+#define ACT_CLEAN_LESS 4	//one fill less per clean
+#define ACT_CLEAN_HOME 5	//leave the fills per clean screen
+#define ACT_FILL_MORE 6		//top off fill one second longer
+#define ACT_FILL_LESS 7		//top off fill one second shorter
+#define ACT_EXT_FILL 8		//fill started by hand, restarts the schedule
+#define ACT_SKIP_TO_FILL 9	//clean is over, fill comes next
+#define ACT_HOME_ENTRY 10
+#define ACT_DISABLED_ENTRY 11
+#define ACT_FILL_ENTRY 12
+#define ACT_FILL_EXIT 13
+#define ACT_CLEAN_ENTRY 14
+#define ACT_CLEAN_EXIT 15
+#define ACT_NEXT_ZONE 16	//LCD shows the next zone, see zone.h
+#define ACT_DIAG_EXIT 17	//closes the SSRs the diagnostics turned on
+#define FSM_ACTIONS 18
+
+//actions run on every pass of the main loop while in a state, index into
+//fsm_polls[] in main.c, they return the event to dispatch or EV_NONE
+#define POLL_NONE 0
+#define POLL_DISABLED 1
+#define POLL_FILLING 2
+#define POLL_CLEANING 3
+#define POLL_DIAG 4
+#define POLL_NIGHT 5
+#define FSM_POLLS 6
+
+typedef struct {
+	char screen;		//mode letter, picks the screen template
+	uint8_t entry;		//ACT_*
+	uint8_t exit;		//ACT_*
+	uint8_t poll;		//POLL_*
+} fsm_state_t;
+
+typedef struct {
+	uint8_t next;		//ST_*, FSM_STAY or FSM_BACK
+	uint8_t action;		//ACT_*, runs between exit and entry
+} fsm_transition_t;
+
+#define FSM_ROW(state) [(state) - FSM_FIRST_STATE]
+
+const fsm_state_t fsm_states[FSM_STATES] PROGMEM = {
+	FSM_ROW(ST_HOME)        = {'h', ACT_HOME_ENTRY,     ACT_NONE,        POLL_NONE},
+	FSM_ROW(ST_MODE)        = {'m', ACT_NONE,           ACT_NONE,        POLL_NONE},
+	FSM_ROW(ST_DISABLE_ASK) = {'e', ACT_NONE,           ACT_NONE,        POLL_NONE},
+	FSM_ROW(ST_DISABLED)    = {'d', ACT_DISABLED_ENTRY, ACT_NONE,        POLL_DISABLED},
+	FSM_ROW(ST_NIGHT_ASK)   = {'n', ACT_NONE,           ACT_NONE,        POLL_NONE},
+	FSM_ROW(ST_CLEAN_SET)   = {'l', ACT_NONE,           ACT_NONE,        POLL_NONE},
+	FSM_ROW(ST_FILL_SET)    = {'i', ACT_NONE,           ACT_NONE,        POLL_NONE},
+	FSM_ROW(ST_FILLING)     = {'f', ACT_FILL_ENTRY,     ACT_FILL_EXIT,   POLL_FILLING},
+	FSM_ROW(ST_CLEANING)    = {'c', ACT_CLEAN_ENTRY,    ACT_CLEAN_EXIT,  POLL_CLEANING},
+	FSM_ROW(ST_DIAG)        = {'a', ACT_NONE,           ACT_DIAG_EXIT,   POLL_DIAG},
+	FSM_ROW(ST_NIGHT)       = {'g', ACT_NONE,           ACT_NONE,        POLL_NIGHT},
+};
+
+//events that start a fill or clean from any idle screen
+#define FSM_IDLE_EVENTS \
+	[EV_EXT_CLEAN]   = {ST_CLEANING, ACT_NONE}, \
+	[EV_EXT_FILL]    = {ST_FILLING,  ACT_EXT_FILL}, \
+	[EV_SCHED_FILL]  = {ST_FILLING,  ACT_NONE}, \
+	[EV_SCHED_CLEAN] = {ST_CLEANING, ACT_NONE}, \
+	[EV_CMD_FILL]    = {ST_FILLING,  ACT_EXT_FILL}, \
+	[EV_CMD_CLEAN]   = {ST_CLEANING, ACT_NONE}, \
+	[EV_CMD_DISABLE] = {ST_DISABLED, ACT_NONE}, \
+	[EV_DARK]        = {ST_NIGHT,    ACT_NONE}
+
+//pairs left out are {FSM_STAY, ACT_NONE}, the event is ignored
+const fsm_transition_t fsm_table[FSM_STATES][FSM_EVENTS] PROGMEM = {
+	FSM_ROW(ST_HOME) = {
+		[EV_KEY0] = {ST_MODE, ACT_NONE},
+		[EV_KEY1] = {ST_DIAG, ACT_NONE},
+		[EV_KEY2] = {ST_CLEAN_SET, ACT_NONE},
+		[EV_KEY3] = {ST_FILL_SET, ACT_NONE},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_MODE) = {
+		[EV_KEY0] = {ST_DISABLE_ASK, ACT_NONE},
+		[EV_KEY1] = {ST_NIGHT_ASK, ACT_NONE},
+#if ZONES > 1
+		[EV_KEY2] = {ST_HOME, ACT_NEXT_ZONE},	//leaves this zone home, shows the next
+#endif
+		[EV_KEY3] = {ST_HOME, ACT_NONE},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_DISABLE_ASK) = {
+		[EV_KEY0] = {ST_DISABLED, ACT_NONE},
+		[EV_KEY1] = {ST_MODE, ACT_NONE},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_DISABLED) = {
+		[EV_KEY3]        = {ST_HOME, ACT_NONE},
+		[EV_EXT_CLEAN]   = {ST_CLEANING, ACT_NONE},
+		[EV_EXT_FILL]    = {ST_FILLING, ACT_EXT_FILL},
+		[EV_CMD_FILL]    = {ST_FILLING, ACT_EXT_FILL},
+		[EV_CMD_CLEAN]   = {ST_CLEANING, ACT_NONE},
+		[EV_CMD_CANCEL]  = {ST_HOME, ACT_NONE},
+	},
+	FSM_ROW(ST_NIGHT_ASK) = {
+		[EV_KEY0] = {ST_HOME, ACT_NIGHT_TOGGLE},
+		[EV_KEY1] = {ST_MODE, ACT_NONE},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_CLEAN_SET) = {
+		[EV_KEY0] = {FSM_STAY, ACT_CLEAN_MORE},
+		[EV_KEY1] = {FSM_STAY, ACT_CLEAN_LESS},
+		[EV_KEY2] = {ST_CLEANING, ACT_NONE},
+		[EV_KEY3] = {ST_HOME, ACT_CLEAN_HOME},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_FILL_SET) = {
+		[EV_KEY0] = {FSM_STAY, ACT_FILL_MORE},
+		[EV_KEY1] = {FSM_STAY, ACT_FILL_LESS},
+		[EV_KEY2] = {ST_HOME, ACT_NONE},
+		[EV_KEY3] = {ST_FILLING, ACT_EXT_FILL},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_FILLING) = {
+		[EV_KEY0]        = {FSM_BACK, ACT_NONE},
+		[EV_KEY1]        = {FSM_BACK, ACT_NONE},
+		[EV_KEY2]        = {FSM_BACK, ACT_NONE},
+		[EV_KEY3]        = {FSM_BACK, ACT_NONE},
+		[EV_KEY_MULTI]   = {FSM_BACK, ACT_NONE},
+		[EV_EXT_CLEAN]   = {FSM_BACK, ACT_NONE},
+		[EV_EXT_FILL]    = {FSM_BACK, ACT_NONE},
+		[EV_CMD_DISABLE] = {ST_DISABLED, ACT_NONE},
+		[EV_CMD_CANCEL]  = {FSM_BACK, ACT_NONE},
+		[EV_TIMEOUT]     = {FSM_BACK, ACT_NONE},
+	},
+	FSM_ROW(ST_CLEANING) = {
+		[EV_KEY0]        = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_KEY1]        = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_KEY2]        = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_KEY3]        = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_KEY_MULTI]   = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_EXT_CLEAN]   = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_EXT_FILL]    = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_CMD_DISABLE] = {ST_DISABLED, ACT_NONE},
+		[EV_CMD_CANCEL]  = {ST_FILLING, ACT_SKIP_TO_FILL},
+		[EV_TIMEOUT]     = {ST_FILLING, ACT_SKIP_TO_FILL},
+	},
+	FSM_ROW(ST_DIAG) = {
+		[EV_KEY3] = {ST_HOME, ACT_NONE},
+		FSM_IDLE_EVENTS,
+	},
+	FSM_ROW(ST_NIGHT) = {
+		[EV_KEY3]        = {ST_HOME, ACT_NIGHT_OFF},
+		[EV_CMD_FILL]    = {ST_FILLING, ACT_EXT_FILL},
+		[EV_CMD_CLEAN]   = {ST_CLEANING, ACT_NONE},
+		[EV_CMD_DISABLE] = {ST_DISABLED, ACT_NONE},
+		[EV_LIGHT]       = {ST_HOME, ACT_NONE},
+	},
+};
+
+#endif /* FSM_H_ */
@@ -0,0 +1,25 @@
+/*
+ * hal.h
+ *
+ * Created: 10/17/2026 4:40:12 PM
+ *  Author: Brandon
+ */ 
+
+
+#ifndef HAL_H_
+#define HAL_H_
+
+//Hardware abstraction for the register accesses that do more than store a
+//value: shifting a byte out of SPI0 or USART0, reading a received byte,
+//EEPROM access, setting and clearing output pins and waiting for an
+//interrupt. Everything else still goes to the registers from
+//avr/io.h directly. Building with HAL_HOST defined swaps in the simulator
+//backend from host/, which provides the registers as plain structs, see the
+//README for the host build.
+#ifdef HAL_HOST
+#include "host/hal_host.h"
+#else
+#include "hal_avr.h"
+#endif
+
+#endif /* HAL_H_ */
@@ -0,0 +1,82 @@
+/*
+ * hal_avr.h
+ *
+ * Created: 10/17/2026 4:41:37 PM
+ *  Author: Brandon
+ */ 
+
+
+#ifndef HAL_AVR_H_
+#define HAL_AVR_H_
+
+//AVR128DB48 backend of hal.h. The functions are static inline so an ISR
+//calling them still compiles to the single register access.
+
+//declares a stdio stream that prints through put and makes it stdout
+#define HAL_STDIO_STREAM(name, put) FILE name = FDEV_SETUP_STREAM(put, NULL, _FDEV_SETUP_WRITE)
+#define HAL_STDIO_OPEN(name) (&(name))
+
+//copies to from from where one side is state an ISR shares, see seqlock.h.
+//The target moves it a byte at a time anyway, so it is a plain assignment.
+#define HAL_COPY(to, from) ((to) = (from))
+
+#endif /* HAL_AVR_H_ */
+
+//called from busy waits and once per main loop pass, interrupts do the
+//waiting on the target so there is nothing to do
+static inline void hal_idle(void) {
+}
+
+//called inside a lock free read and while a double buffered copy is
+//filled, see seqlock.h, where the host simulator can run an interrupt. On
+//the target they come on their own.
+static inline void hal_preempt(void) {
+}
+
+//starts shifting a byte out to the LCD, SPI0_INT_vect runs when it is done
+static inline void hal_spi_write(uint8_t byte) {
+	SPI0.DATA = byte;
+}
+
+//starts sending a byte over USART0
+static inline void hal_usart_write(uint8_t byte) {
+	USART0.TXDATAL = byte;
+}
+
+//takes the received byte, clears RXCIF
+static inline uint8_t hal_usart_read(void) {
+	return USART0.RXDATAL;
+}
+
+//turns the pins in mask on, a single write that leaves the other pins alone
+//even if an interrupt changes them at the same time
+static inline void hal_port_set(PORT_t *port, uint8_t mask) {
+	port->OUTSET = mask;
+}
+
+//turns the pins in mask off, see hal_port_set()
+static inline void hal_port_clear(PORT_t *port, uint8_t mask) {
+	port->OUTCLR = mask;
+}
+
+//reads a byte of EEPROM, which is mapped into data space
+static inline uint8_t hal_eeprom_read(uint16_t addr) {
+	return *(volatile uint8_t *)(EEPROM_START + addr);
+}
+
+//starts erasing and writing one byte of EEPROM, takes about 11 ms during
+//which hal_eeprom_busy() is true. The command register is protected, so
+//interrupts are held off until the byte is handed over.
+static inline void hal_eeprom_write(uint16_t addr, uint8_t byte) {
+	uint8_t sreg = SREG;
+	cli();
+	_PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_EEERWR_gc);
+	*(volatile uint8_t *)(EEPROM_START + addr) = byte;
+	_PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_NONE_gc);
+	SREG = sreg;
+}
+
+//1 while an EEPROM write is in progress
+static inline uint8_t hal_eeprom_busy(void) {
+	return (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm) != 0;
+}
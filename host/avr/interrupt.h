@@ -0,0 +1,21 @@
+/*
+ * interrupt.h
+ *
+ * Host stand-in for <avr/interrupt.h>. The simulator only runs interrupt
+ * handlers from hal_idle() and only while the I bit is set.
+ */
+
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+void sim_sei(void);
+void sim_cli(void);
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+#define ISR(vector, ...) void vector(void)
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
@@ -0,0 +1,172 @@
+/*
+ * io.h
+ *
+ * Host stand-in for <avr/io.h>. The peripheral registers the firmware uses
+ * are plain structs with the AVR128DB48 member names, sim.c owns them and
+ * plays the part of the hardware behind them.
+ */
+
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+
+typedef struct {
+	register8_t DIR, DIRSET, DIRCLR, DIRTGL;
+	register8_t OUT, OUTSET, OUTCLR, OUTTGL;
+	register8_t IN, INTFLAGS, PORTCTRL, PINCONFIG;
+	register8_t PINCTRLUPD, PINCTRLSET, PINCTRLCLR, reserved;
+	register8_t PIN0CTRL, PIN1CTRL, PIN2CTRL, PIN3CTRL;
+	register8_t PIN4CTRL, PIN5CTRL, PIN6CTRL, PIN7CTRL;
+} PORT_t;
+
+typedef struct {
+	register8_t CTRLA, CTRLB, INTCTRL, INTFLAGS, DATA;
+} SPI_t;
+
+typedef struct {
+	register8_t CTRLA, CTRLB, CTRLC, CTRLD, CTRLE, SAMPCTRL;
+	register8_t MUXPOS, MUXNEG, COMMAND, EVCTRL, INTCTRL, INTFLAGS;
+	register8_t DBGCTRL, TEMP;
+	register16_t RES, WINLT, WINHT;
+} ADC_t;
+
+typedef struct {
+	register8_t RXDATAL, RXDATAH, TXDATAL, TXDATAH;
+	register8_t STATUS, CTRLA, CTRLB, CTRLC;
+	register16_t BAUD;
+} USART_t;
+
+typedef struct {
+	register8_t CTRLA, CTRLB, CTRLC, CTRLD;
+	register8_t CTRLECLR, CTRLESET, CTRLFCLR, CTRLFSET;
+	register8_t EVCTRL, INTCTRL, INTFLAGS;
+	register16_t CNT, PER, CMP0, CMP1, CMP2;
+} TCA_SINGLE_t;
+
+typedef union {
+	TCA_SINGLE_t SINGLE;
+} TCA_t;
+
+typedef struct {
+	register8_t CTRLA, CTRLB, EVCTRL, INTCTRL, INTFLAGS, STATUS, DBGCTRL, TEMP;
+	register16_t CNT, CCMP;
+} TCB_t;
+
+typedef struct {
+	register8_t ADC0REF, DAC0REF, ACREF;
+} VREF_t;
+
+typedef struct {
+	register8_t CTRLA, STATUS, INTCTRL, INTFLAGS, TEMP, DBGCTRL, CALIB, CLKSEL;
+	register16_t CNT, PER, CMP;
+	register8_t PITCTRLA, PITSTATUS, PITINTCTRL, PITINTFLAGS;
+} RTC_t;
+
+typedef struct {
+	register8_t CTRLA, CTRLB, STATUS, INTCTRL, INTFLAGS;
+	register16_t DATA;
+	register16_t ADDR;
+} NVMCTRL_t;
+
+extern PORT_t PORTA, PORTC, PORTD, PORTF;
+extern SPI_t SPI0;
+extern ADC_t ADC0;
+extern USART_t USART0;
+extern TCA_t TCA0;
+extern TCB_t TCB0, TCB1, TCB2, TCB3;
+extern VREF_t VREF;
+extern RTC_t RTC;
+extern NVMCTRL_t NVMCTRL;
+extern register8_t CCP;
+
+//the I bit of the status register, reads only
+uint8_t sim_sreg(void);
+#define SREG sim_sreg()
+#define CPU_I_bm 0x80
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+
+#define PORT_ISC_gm 0x07
+#define PORT_ISC_INPUT_DISABLE_gc 0x04
+#define PORT_PULLUPEN_bm 0x08
+
+#define SPI_ENABLE_bm 0x01
+#define SPI_IE_bm 0x01
+#define SPI_IF_bm 0x80
+
+#define ADC_ENABLE_bm 0x01
+#define ADC_RESRDY_bm 0x01
+#define ADC_STCONV_bm 0x01
+#define ADC_PRESC_DIV128_gc 0x0C
+#define ADC_SAMPNUM_ACC16_gc 0x04
+#define VREF_REFSEL_2V048_gc 0x01
+
+#define USART_RXCIE_bm 0x80
+#define USART_DREIE_bm 0x20
+#define USART_TXEN_bm 0x40
+#define USART_RXEN_bm 0x80
+#define USART_RXCIF_bm 0x80
+#define USART_DREIF_bm 0x20
+
+#define TCA_SINGLE_OVF_bm 0x01
+#define TCA_SINGLE_WGMODE_NORMAL_gc 0x00
+#define TCA_SINGLE_CNTAEI_bm 0x01
+#define TCA_SINGLE_CLKSEL_gm 0x0E
+#define TCA_SINGLE_CLKSEL_DIV256_gc 0x0C
+#define TCA_SINGLE_ENABLE_bm 0x01
+
+#define TCB_ENABLE_bm 0x01
+#define TCB_CLKSEL_gm 0x0E
+#define TCB_CLKSEL_DIV1_gc 0x00
+#define TCB_CLKSEL_DIV2_gc 0x02
+#define TCB_CNTMODE_INT_gc 0x00
+#define TCB_CAPT_bm 0x01
+
+#define RTC_RTCEN_bm 0x01
+#define RTC_PRESCALER_gm 0x78
+#define RTC_PRESCALER_DIV32_gc 0x28
+#define RTC_RUNSTDBY_bm 0x80
+#define RTC_OVF_bm 0x01
+#define RTC_CLKSEL_OSC32K_gc 0x00
+
+#define EEPROM_SIZE 512
+
+//interrupt vectors are plain functions on the host, weak so sim.c links
+//whether or not the firmware defines a handler
+#define SPI0_INT_vect sim_vect_SPI0_INT
+#define TCA0_OVF_vect sim_vect_TCA0_OVF
+#define TCB0_INT_vect sim_vect_TCB0_INT
+#define TCB1_INT_vect sim_vect_TCB1_INT
+#define TCB2_INT_vect sim_vect_TCB2_INT
+#define TCB3_INT_vect sim_vect_TCB3_INT
+#define ADC0_RESRDY_vect sim_vect_ADC0_RESRDY
+#define USART0_RXC_vect sim_vect_USART0_RXC
+#define USART0_DRE_vect sim_vect_USART0_DRE
+#define RTC_CNT_vect sim_vect_RTC_CNT
+#define NVMCTRL_EE_vect sim_vect_NVMCTRL_EE
+
+void SPI0_INT_vect(void) __attribute__((weak));
+void TCA0_OVF_vect(void) __attribute__((weak));
+void TCB0_INT_vect(void) __attribute__((weak));
+void TCB1_INT_vect(void) __attribute__((weak));
+void TCB2_INT_vect(void) __attribute__((weak));
+void TCB3_INT_vect(void) __attribute__((weak));
+void ADC0_RESRDY_vect(void) __attribute__((weak));
+void USART0_RXC_vect(void) __attribute__((weak));
+void USART0_DRE_vect(void) __attribute__((weak));
+void RTC_CNT_vect(void) __attribute__((weak));
+void NVMCTRL_EE_vect(void) __attribute__((weak));
+
+#endif /* HOST_AVR_IO_H_ */
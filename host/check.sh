@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# check.sh
+#
+# Builds the host simulator and runs the scripted checks against it. Run
+# from the top of the repository, exits non-zero if a check fails:
+#	sh host/check.sh
+#
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+gcc -std=gnu99 -O2 -DHAL_HOST -Ihost -o "$dir/bath_sim" main.c host/sim.c || exit 1
+gcc -std=gnu99 -O2 -DHAL_HOST -Ihost -DZONES=2 \
+	'-DZONE_PINS={0b00000100,0,0b00001000,0,0,0b10000000},{0,0b00000001,0,0b00000100,0,0}' \
+	-o "$dir/bath_sim2" main.c host/sim.c || exit 1
+gcc -std=gnu99 -O2 -DHAL_HOST -Ihost -o "$dir/stress" host/stress.c host/sim.c || exit 1
+failed=0
+
+#reports a check, $1 is its name, $2 what it printed and $3 what it should
+check() {
+	if [ "$2" = "$3" ]; then
+		echo "$1: ok"
+	else
+		echo "$1: FAILED"
+		echo "  expected: $3"
+		echo "  got:      $2"
+		failed=1
+	fi
+}
+
+#diagnostics screen open when a scheduled fill comes due, the interlock
+#must not trip and the SSRs the diagnostics turned on must be closed
+SIM_PTY=0 SIM_SECONDS=3630 SIM_SCRIPT=host/scripts/diag_fill.txt "$dir/bath_sim" >"$dir/diag_fill.out" 2>/dev/null
+check diag_fill "$(grep -a -o 'valves.*' "$dir/diag_fill.out" | tr '\n' ' ')" \
+	"valves a=04 d=82 trips=0 valves a=00 d=00 trips=0 "
+
+#two zones, the diagnostics of one must leave the fill of the other alone
+SIM_PTY=0 SIM_SECONDS=220 SIM_SCRIPT=host/scripts/diag_zone2.txt "$dir/bath_sim2" >"$dir/diag_zone2.out" 2>/dev/null
+check diag_zone2 "$(grep -a -o 'valves.*' "$dir/diag_zone2.out" | tr '\n' ' ')" \
+	"valves a=04 d=82 trips=0 valves a=04 d=82 trips=0 valves a=00 d=00 trips=0 \
+valves a=0C d=82 trips=0 valves a=04 d=82 trips=0 valves a=04 d=82 trips=0 \
+valves a=00 d=00 trips=0 "
+
+#the ISRs run inside every byte of every lock free access, readers must get
+#whole values and the ISRs whole double buffered copies
+SIM_PTY=0 "$dir/stress" >"$dir/stress.out" 2>/dev/null
+check stress "$(grep -v ': ok' "$dir/stress.out")" ""
+
+#interrupts run inside every lock free access must not change anything the
+#firmware sends, over a day of fills and cleans with the diagnostics and
+#commands of the script above
+for script in /dev/null host/scripts/diag_fill.txt; do
+	SIM_PTY=0 SIM_SECONDS=100000 SIM_SCRIPT=$script "$dir/bath_sim" >"$dir/plain.out" 2>/dev/null
+	SIM_PTY=0 SIM_SECONDS=100000 SIM_SCRIPT=$script SIM_PREEMPT=1 "$dir/bath_sim" >"$dir/preempt.out" 2>/dev/null
+	check "preempt $(basename $script)" "$(cmp "$dir/plain.out" "$dir/preempt.out" && echo same)" same
+done
+
+exit $failed
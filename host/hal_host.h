@@ -0,0 +1,44 @@
+/*
+ * hal_host.h
+ *
+ * Host backend of hal.h, the functions are in sim.c.
+ */
+
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+//the stream is opened with fopencookie() so printf ends up in put
+typedef int (*hal_put_t)(char character, FILE *stream);
+FILE *sim_stdio_open(hal_put_t put);
+
+#define HAL_STDIO_STREAM(name, put) const hal_put_t name = put
+#define HAL_STDIO_OPEN(name) sim_stdio_open(name)
+
+//copies a byte at a time like the target and calls hal_preempt() before
+//every byte, so an interrupt can land in the middle of the value
+void hal_copy(volatile void *to, const volatile void *from, uint8_t len);
+#define HAL_COPY(to, from) hal_copy(&(to), &(from), sizeof(to))
+
+//moves simulated time on to the next peripheral event and runs the
+//interrupt handlers that became due
+void hal_idle(void);
+//with SIM_PREEMPT=1 runs the next interrupt inside lock free reads and
+//double buffered writes, see seqlock.h
+void hal_preempt(void);
+//called by hal_preempt() instead when set, host/stress.c runs the ISRs
+//from it
+extern void (*sim_preempt_hook)(void);
+void hal_spi_write(uint8_t byte);
+void hal_usart_write(uint8_t byte);
+uint8_t hal_usart_read(void);
+void hal_port_set(PORT_t *port, uint8_t mask);
+void hal_port_clear(PORT_t *port, uint8_t mask);
+uint8_t hal_eeprom_read(uint16_t addr);
+void hal_eeprom_write(uint16_t addr, uint8_t byte);
+uint8_t hal_eeprom_busy(void);
+
+#endif /* HAL_HOST_H_ */
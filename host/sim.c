@@ -0,0 +1,781 @@
+/*
+ * sim.c
+ *
+ * Host simulator for the bird bath firmware. main.c is built unchanged
+ * against the headers in host/ and linked with this file, which plays the
+ * AVR128DB48 peripherals the firmware uses:
+ *
+ *	TCA0, TCB0-3	periodic interrupts from CCMP/PER and the clock select
+ *	RTC				overflow interrupt and CNT from a 32.768 kHz clock
+ *	SPI0			bytes go to a virtual DOG204 (ST7036) display
+ *	ADC0			conversions of the solar panel and the three SSR sense
+ *					lines, the SSR lines follow the valve outputs
+ *	USART0			a pty, or stdout when SIM_PTY=0
+ *	PORTC, PORTF	buttons pressed from a script
+ *
+ * Simulated time only moves in hal_idle() and the delay functions, straight
+ * to the next peripheral event, so a run is deterministic and goes as fast
+ * as the host can execute the firmware. Interrupt handlers are called from
+ * there too, while the firmware has the I bit set.
+ *
+ * Settings come from the environment:
+ *	SIM_SECONDS=n	stop after n simulated seconds, default runs forever
+ *	SIM_SPEED=n		run n times faster than real time, 0 (default) is as
+ *					fast as possible
+ *	SIM_PTY=0		send USART0 to stdout instead of a pty
+ *	SIM_LCD=1		print the display to stderr whenever it changes
+ *	SIM_SOLAR_MV=n	fixed solar panel voltage, default follows the clock
+ *	SIM_SOLAR_NOISE=n	adds up to +-n mV of noise to every solar reading
+ *	SIM_START_HOUR=h	time of day the simulation starts at, default 8
+ *	SIM_EEPROM=file	keeps the EEPROM in file across runs, default starts
+ *					erased every run
+ *	SIM_SCRIPT=file	timed inputs, one per line: "<second> <action>" with
+ *					action one of "key <0-3>", "ext fill", "ext clean",
+ *					"cmd <text>", "hex <bytes>" or "solar <mV>|auto",
+ *					hex sends raw bytes such as binary requests
+ *	SIM_PREEMPT=1	runs the next interrupt in the middle of lock free reads
+ *					of state an ISR writes, which have to notice and read
+ *					again, and while the main loop fills a double buffered
+ *					copy an ISR reads, between the bytes of every
+ *					HAL_COPY(), see seqlock.h. host/stress.c runs each ISR
+ *					at every one of these points in turn.
+ *
+ * Valve changes and the end of run summary go to stderr.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+#include "hal_host.h"
+
+#define SIM_F_CPU 4000000ULL
+#define SIM_NS_PER_CYCLE (1000000000ULL / SIM_F_CPU)
+#define SIM_NEVER UINT64_MAX
+
+#define SIM_SPI_NS (8 * 4 * SIM_NS_PER_CYCLE)				//8 bits at F_CPU/4
+#define SIM_USART_NS (10 * 1000000000ULL / 115200)			//start, 8 data, stop
+#define SIM_ADC_NS (16 * 15 * 128 * SIM_NS_PER_CYCLE)		//ACC16, 15 ADC clocks, F_CPU/128
+#define SIM_RX_POLL_NS 20000000ULL							//how often the pty is read
+#define SIM_PRESS_NS 100000000ULL							//how long a button is held
+#define SIM_EEPROM_NS 11000000ULL							//erase and write of one byte
+
+//the registers the firmware sees
+PORT_t PORTA, PORTC, PORTD, PORTF;
+SPI_t SPI0;
+ADC_t ADC0;
+USART_t USART0;
+TCA_t TCA0;
+TCB_t TCB0, TCB1, TCB2, TCB3;
+VREF_t VREF;
+RTC_t RTC;
+NVMCTRL_t NVMCTRL;
+register8_t CCP;
+
+static uint64_t sim_now;				//simulated nanoseconds since reset
+static uint64_t sim_end = SIM_NEVER;
+static uint32_t sim_speed;
+static uint8_t sim_i_bit;				//global interrupt enable
+static uint8_t sim_in_isr;
+static uint8_t sim_preempt;
+static uint32_t sim_preempts;			//interrupts run inside lock free accesses
+void (*sim_preempt_hook)(void);
+static struct timespec sim_wall_start;
+
+//timer state, due is the next interrupt or SIM_NEVER while stopped
+typedef struct {
+	TCB_t *tcb;
+	void (*vect)(void);
+	uint64_t due;
+} sim_tcb_t;
+
+static sim_tcb_t sim_tcb[4] = {
+	{&TCB0, 0, SIM_NEVER}, {&TCB1, 0, SIM_NEVER},
+	{&TCB2, 0, SIM_NEVER}, {&TCB3, 0, SIM_NEVER},
+};
+static uint64_t sim_tca_due = SIM_NEVER;
+static uint64_t sim_rtc_due = SIM_NEVER;
+static uint64_t sim_rtc_base;			//time of the last RTC overflow
+
+static uint64_t sim_spi_due = SIM_NEVER;
+static uint8_t sim_spi_byte;
+
+static uint64_t sim_adc_due = SIM_NEVER;
+
+static int sim_pty = -1;
+static uint64_t sim_tx_free;			//data register empty from here on
+static uint64_t sim_rx_due;				//next time a received byte can arrive
+static char sim_rx_buf[256];
+static uint8_t sim_rx_head, sim_rx_tail;
+
+//virtual DOG204, 4 lines of 20 visible cells at DDRAM 0x00, 0x20, 0x40, 0x60
+static uint8_t lcd_frame[3];
+static uint8_t lcd_frame_len;
+static uint8_t lcd_re;
+static uint8_t lcd_addr;
+static char lcd_ddram[128];
+static char lcd_printed[4][21];
+static uint8_t sim_show_lcd;
+
+static uint8_t sim_eeprom[EEPROM_SIZE];
+static int sim_eeprom_fd = -1;
+static uint64_t sim_eeprom_due;			//busy until
+
+static int sim_solar_mv = -1;			//-1 follows the time of day
+static int sim_solar_noise;
+static uint32_t sim_noise_state = 1;
+static uint32_t sim_start_hour = 8;
+
+static FILE *sim_script;
+static uint64_t sim_script_due = SIM_NEVER;
+static char sim_script_action[128];
+static uint64_t sim_release_due = SIM_NEVER;
+
+static uint8_t sim_valves;
+static uint32_t sim_fills, sim_cleans;
+
+static void sim_run(uint64_t limit);
+
+static void sim_print_time(FILE *out, uint64_t ns) {
+	uint64_t s = ns / 1000000000ULL;
+	fprintf(out, "[%3llu+%02llu:%02llu:%02llu.%03llu]", (unsigned long long)(s / 86400),
+		(unsigned long long)(s / 3600 % 24), (unsigned long long)(s / 60 % 60),
+		(unsigned long long)(s % 60), (unsigned long long)(ns / 1000000 % 1000));
+}
+
+/* interrupt flag ******************************************************/
+
+uint8_t sim_sreg(void) {
+	return sim_i_bit ? CPU_I_bm : 0;
+}
+
+void sim_sei(void) {
+	sim_i_bit = 1;
+}
+
+void sim_cli(void) {
+	sim_i_bit = 0;
+}
+
+uint8_t sim_irq_save(void) {
+	uint8_t sreg = sim_sreg();
+	sim_i_bit = 0;
+	return sreg;
+}
+
+void sim_irq_restore(const uint8_t *sreg) {
+	sim_i_bit = (*sreg & CPU_I_bm) != 0;
+}
+
+/* virtual LCD *********************************************************/
+
+static void lcd_command(uint8_t cmd) {
+	if ((cmd & 0xE0) == 0x20) {			//function set, RE selects the extended set
+		lcd_re = (cmd & 0x02) != 0;
+	} else if (cmd == 0x01) {
+		memset(lcd_ddram, ' ', sizeof(lcd_ddram));
+		lcd_addr = 0;
+	} else if ((cmd & 0x80) && !lcd_re) {
+		lcd_addr = cmd & 0x7F;
+	}
+}
+
+static void lcd_byte(uint8_t byte) {
+	if (byte == 0x1F || byte == 0x5F) {	//start byte, RS in bit 6
+		lcd_frame[0] = byte;
+		lcd_frame_len = 1;
+		return;
+	}
+	if (lcd_frame_len == 0) {
+		return;
+	}
+	lcd_frame[lcd_frame_len++] = byte;
+	if (lcd_frame_len < 3) {
+		return;
+	}
+	lcd_frame_len = 0;
+	uint8_t value = (lcd_frame[1] & 0x0F) | (lcd_frame[2] << 4);
+	if (lcd_frame[0] == 0x1F) {
+		lcd_command(value);
+	} else {
+		lcd_ddram[lcd_addr] = value;
+		lcd_addr = (lcd_addr + 1) & 0x7F;
+	}
+}
+
+static void lcd_show(void) {
+	uint8_t changed = 0;
+	for (uint8_t line = 0; line < 4; line++) {
+		if (memcmp(lcd_printed[line], &lcd_ddram[line * 0x20], 20)) {
+			memcpy(lcd_printed[line], &lcd_ddram[line * 0x20], 20);
+			changed = 1;
+		}
+	}
+	if (!changed) {
+		return;
+	}
+	sim_print_time(stderr, sim_now);
+	fprintf(stderr, " +--------------------+\n");
+	for (uint8_t line = 0; line < 4; line++) {
+		fprintf(stderr, "                   |%.20s|\n", lcd_printed[line]);
+	}
+	fprintf(stderr, "                   +--------------------+\n");
+}
+
+/* USART ***************************************************************/
+
+static ssize_t sim_stdio_write(void *cookie, const char *buf, size_t size) {
+	hal_put_t put = (hal_put_t)cookie;
+	for (size_t i = 0; i < size; i++) {
+		put(buf[i], stdout);
+	}
+	return size;
+}
+
+FILE *sim_stdio_open(hal_put_t put) {
+	cookie_io_functions_t io = {0, sim_stdio_write, 0, 0};
+	FILE *stream = fopencookie((void *)put, "w", io);
+	setvbuf(stream, NULL, _IONBF, 0);
+	return stream;
+}
+
+void hal_usart_write(uint8_t byte) {
+	ssize_t n;
+	if (sim_pty >= 0) {
+		n = write(sim_pty, &byte, 1);		//dropped when nobody reads the pty
+	} else {
+		n = write(STDOUT_FILENO, &byte, 1);
+	}
+	(void)n;
+	sim_tx_free = sim_now + SIM_USART_NS;
+	USART0.STATUS &= ~USART_DREIF_bm;
+}
+
+uint8_t hal_usart_read(void) {
+	USART0.STATUS &= ~USART_RXCIF_bm;
+	return USART0.RXDATAL;
+}
+
+static void sim_rx_put(const char *text) {
+	while (*text && (uint8_t)(sim_rx_head + 1) != sim_rx_tail) {
+		sim_rx_buf[sim_rx_head++] = *text++;
+	}
+}
+
+static void sim_rx_byte(uint8_t byte) {
+	if ((uint8_t)(sim_rx_head + 1) != sim_rx_tail) {
+		sim_rx_buf[sim_rx_head++] = byte;
+	}
+}
+
+static void sim_rx_poll(void) {
+	char buf[64];
+	ssize_t n;
+	if (sim_pty < 0) {
+		return;
+	}
+	n = read(sim_pty, buf, sizeof(buf) - 1);
+	if (n > 0) {
+		buf[n] = '\0';
+		for (ssize_t i = 0; i < n; i++) {
+			if (buf[i] == '\r') {
+				buf[i] = '\n';	//terminals send CR for enter
+			}
+		}
+		sim_rx_put(buf);
+	}
+}
+
+/* SPI *****************************************************************/
+
+void hal_spi_write(uint8_t byte) {
+	SPI0.DATA = byte;
+	SPI0.INTFLAGS &= ~SPI_IF_bm;
+	sim_spi_byte = byte;
+	sim_spi_due = sim_now + SIM_SPI_NS;
+}
+
+/* EEPROM **************************************************************/
+
+uint8_t hal_eeprom_read(uint16_t addr) {
+	return sim_eeprom[addr % EEPROM_SIZE];
+}
+
+void hal_eeprom_write(uint16_t addr, uint8_t byte) {
+	addr %= EEPROM_SIZE;
+	sim_eeprom[addr] = byte;
+	sim_eeprom_due = sim_now + SIM_EEPROM_NS;
+	if (sim_eeprom_fd >= 0 && pwrite(sim_eeprom_fd, &byte, 1, addr) != 1) {
+		fprintf(stderr, "sim: EEPROM write failed: %s\n", strerror(errno));
+	}
+}
+
+uint8_t hal_eeprom_busy(void) {
+	return sim_now < sim_eeprom_due;
+}
+
+static void sim_eeprom_open(const char *path) {
+	ssize_t n;
+	sim_eeprom_fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (sim_eeprom_fd < 0) {
+		fprintf(stderr, "sim: cannot open %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	n = pread(sim_eeprom_fd, sim_eeprom, EEPROM_SIZE, 0);
+	if (n < EEPROM_SIZE) {		//new file, the rest is erased
+		n = (n < 0) ? 0 : n;
+		if (pwrite(sim_eeprom_fd, sim_eeprom + n, EEPROM_SIZE - n, n) != EEPROM_SIZE - n) {
+			fprintf(stderr, "sim: cannot write %s: %s\n", path, strerror(errno));
+			exit(1);
+		}
+	}
+}
+
+/* ADC *****************************************************************/
+
+//xorshift, the same noise every run
+static int sim_noise(int range) {
+	sim_noise_state ^= sim_noise_state << 13;
+	sim_noise_state ^= sim_noise_state >> 17;
+	sim_noise_state ^= sim_noise_state << 5;
+	return (int)(sim_noise_state % (2 * range + 1)) - range;
+}
+
+static uint16_t sim_solar(void) {
+	int mv = sim_solar_mv;
+	if (mv < 0) {	//daylight from 6:00 to 20:00
+		uint32_t hour = (sim_now / 3600000000000ULL + sim_start_hour) % 24;
+		mv = (hour >= 6 && hour < 20) ? 2400 : 300;
+	}
+	if (sim_solar_noise > 0) {
+		mv += sim_noise(sim_solar_noise);
+	}
+	return (mv < 0) ? 0 : (mv > 2500) ? 2500 : mv;
+}
+
+static uint16_t sim_adc_mv(uint8_t muxpos) {
+	switch (muxpos) {
+		case 3:		//solar panel
+			return sim_solar();
+		case 4:		//fill SSR
+			return (PORTA.OUT & PIN2_bm) ? 2400 : 0;
+		case 5:		//BB2 SSR
+			return (PORTD.OUT & PIN7_bm) ? 2400 : 0;
+		case 6:		//clean SSR
+			return (PORTA.OUT & PIN3_bm) ? 2400 : 0;
+	}
+	return 0;
+}
+
+/* buttons and script **************************************************/
+
+static void sim_script_next(void) {
+	char line[160];
+	double seconds;
+	int used;
+	sim_script_due = SIM_NEVER;
+	while (sim_script && fgets(line, sizeof(line), sim_script)) {
+		if (line[0] == '#' || sscanf(line, "%lf %n", &seconds, &used) < 1) {
+			continue;
+		}
+		line[strcspn(line, "\r\n")] = '\0';
+		snprintf(sim_script_action, sizeof(sim_script_action), "%s", line + used);
+		sim_script_due = (uint64_t)(seconds * 1e9);
+		return;
+	}
+}
+
+static void sim_script_run(void) {
+	const char *action = sim_script_action;
+	unsigned key;
+	unsigned byte;
+	int mv;
+	int used;
+	if (sscanf(action, "key %u", &key) == 1 && key < 4) {
+		PORTC.IN &= ~(1 << key);
+		sim_release_due = sim_now + SIM_PRESS_NS;
+	} else if (!strcmp(action, "ext fill")) {
+		PORTF.IN &= ~PIN0_bm;
+		sim_release_due = sim_now + SIM_PRESS_NS;
+	} else if (!strcmp(action, "ext clean")) {
+		PORTF.IN &= ~PIN1_bm;
+		sim_release_due = sim_now + SIM_PRESS_NS;
+	} else if (!strncmp(action, "cmd ", 4)) {
+		sim_rx_put(action + 4);
+		sim_rx_put("\n");
+	} else if (!strncmp(action, "hex ", 4)) {
+		action += 4;
+		while (sscanf(action, "%x%n", &byte, &used) == 1) {
+			sim_rx_byte(byte);
+			action += used;
+		}
+	} else if (!strcmp(action, "solar auto")) {
+		sim_solar_mv = -1;
+	} else if (sscanf(action, "solar %d", &mv) == 1) {
+		sim_solar_mv = mv;
+	} else {
+		sim_print_time(stderr, sim_now);
+		fprintf(stderr, " script: unknown action \"%s\"\n", action);
+	}
+	sim_script_next();
+}
+
+/* valves **************************************************************/
+
+//OUTSET and OUTCLR are plain struct fields here, so the firmware's pin
+//writes go straight to OUT
+void hal_port_set(PORT_t *port, uint8_t mask) {
+	port->OUT |= mask;
+}
+
+void hal_port_clear(PORT_t *port, uint8_t mask) {
+	port->OUT &= ~mask;
+}
+
+static uint8_t sim_valve_state(void) {
+	return ((PORTA.OUT & PIN2_bm) ? 1 : 0) | ((PORTA.OUT & PIN3_bm) ? 2 : 0) |
+		((PORTD.OUT & PIN7_bm) ? 4 : 0) | ((PORTD.OUT & PIN1_bm) ? 8 : 0);
+}
+
+static void sim_watch_valves(void) {
+	uint8_t valves = sim_valve_state();
+	if (valves == sim_valves) {
+		return;
+	}
+	sim_fills += (valves & ~sim_valves & 1) != 0;
+	sim_cleans += (valves & ~sim_valves & 2) != 0;
+	sim_valves = valves;
+	sim_print_time(stderr, sim_now);
+	fprintf(stderr, " fill=%d clean=%d bb2=%d enac=%d\n", valves & 1, (valves >> 1) & 1,
+		(valves >> 2) & 1, (valves >> 3) & 1);
+}
+
+/* time ****************************************************************/
+
+static uint64_t sim_tcb_period(TCB_t *tcb) {
+	uint64_t div = ((tcb->CTRLA & TCB_CLKSEL_gm) == TCB_CLKSEL_DIV2_gc) ? 2 : 1;
+	return ((uint64_t)tcb->CCMP + 1) * div * SIM_NS_PER_CYCLE;
+}
+
+static uint64_t sim_tca_period(void) {
+	static const uint16_t div[8] = {1, 2, 4, 8, 16, 64, 256, 1024};
+	uint8_t clksel = (TCA0.SINGLE.CTRLA & TCA_SINGLE_CLKSEL_gm) >> 1;
+	return ((uint64_t)TCA0.SINGLE.PER + 1) * div[clksel] * SIM_NS_PER_CYCLE;
+}
+
+static uint64_t sim_rtc_prescale(void) {
+	return 1ULL << ((RTC.CTRLA & RTC_PRESCALER_gm) >> 3);
+}
+
+static uint64_t sim_rtc_period(void) {
+	return ((uint64_t)RTC.PER + 1) * sim_rtc_prescale() * 1000000000ULL / 32768;
+}
+
+//picks up timers and conversions the firmware started or stopped
+static void sim_sync(void) {
+	for (uint8_t i = 0; i < 4; i++) {
+		sim_tcb_t *t = &sim_tcb[i];
+		if (!(t->tcb->CTRLA & TCB_ENABLE_bm)) {
+			t->due = SIM_NEVER;
+		} else if (t->due == SIM_NEVER || t->tcb->CNT == 0) {
+			//started, or restarted by writing CNT = 0, which the sim
+			//notices because it keeps CNT nonzero while counting
+			t->due = sim_now + sim_tcb_period(t->tcb);
+			t->tcb->CNT = 1;
+		}
+	}
+	if (!(TCA0.SINGLE.CTRLA & TCA_SINGLE_ENABLE_bm)) {
+		sim_tca_due = SIM_NEVER;
+	} else if (sim_tca_due == SIM_NEVER) {
+		sim_tca_due = sim_now + sim_tca_period();
+	}
+	if (!(RTC.CTRLA & RTC_RTCEN_bm)) {
+		sim_rtc_due = SIM_NEVER;
+	} else {
+		if (sim_rtc_due == SIM_NEVER) {
+			sim_rtc_base = sim_now;
+			sim_rtc_due = sim_now + sim_rtc_period();
+		}
+		RTC.CNT = (sim_now - sim_rtc_base) * 32768 / 1000000000ULL / sim_rtc_prescale();
+	}
+	if ((ADC0.CTRLA & ADC_ENABLE_bm) && (ADC0.COMMAND & ADC_STCONV_bm) && sim_adc_due == SIM_NEVER) {
+		sim_adc_due = sim_now + SIM_ADC_NS;
+	}
+	if (sim_now >= sim_tx_free) {
+		USART0.STATUS |= USART_DREIF_bm;
+	}
+}
+
+static void sim_isr(void (*vect)(void)) {
+	if (!vect) {
+		return;
+	}
+	sim_i_bit = 0;
+	sim_in_isr = 1;
+	vect();
+	sim_in_isr = 0;
+	sim_i_bit = 1;
+	sim_sync();
+}
+
+static uint64_t sim_min(uint64_t a, uint64_t b) {
+	return a < b ? a : b;
+}
+
+//next time anything happens, or now if an interrupt is already waiting
+static uint64_t sim_next_event(void) {
+	uint64_t next = sim_min(sim_tca_due, sim_spi_due);
+	next = sim_min(next, sim_rtc_due);
+	for (uint8_t i = 0; i < 4; i++) {
+		next = sim_min(next, sim_tcb[i].due);
+	}
+	next = sim_min(next, sim_adc_due);
+	next = sim_min(next, sim_script_due);
+	next = sim_min(next, sim_release_due);
+	if (USART0.CTRLA & USART_DREIE_bm) {
+		next = sim_min(next, sim_tx_free);
+	}
+	if (sim_rx_head != sim_rx_tail || sim_pty >= 0) {
+		next = sim_min(next, sim_rx_due);
+	}
+	return sim_min(next, sim_end);
+}
+
+//sleeps so simulated time runs at most SIM_SPEED times faster than the wall
+static void sim_pace(void) {
+	struct timespec now, wait;
+	int64_t ahead;
+	if (!sim_speed) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ahead = (int64_t)(sim_now / sim_speed) - ((int64_t)(now.tv_sec - sim_wall_start.tv_sec) * 1000000000LL +
+		(now.tv_nsec - sim_wall_start.tv_nsec));
+	if (ahead > 1000000) {
+		wait.tv_sec = ahead / 1000000000LL;
+		wait.tv_nsec = ahead % 1000000000LL;
+		nanosleep(&wait, NULL);
+	}
+}
+
+static void sim_finish(void) {
+	struct timespec now;
+	double wall;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wall = (now.tv_sec - sim_wall_start.tv_sec) + (now.tv_nsec - sim_wall_start.tv_nsec) / 1e9;
+	sim_print_time(stderr, sim_now);
+	fprintf(stderr, " done: %u fills, %u cleans, %.1f s wall, %.0fx real time\n",
+		sim_fills, sim_cleans, wall, wall > 0 ? sim_now / 1e9 / wall : 0.0);
+	if (sim_preempt) {
+		fprintf(stderr, "sim: %u interrupts inside lock free accesses\n", sim_preempts);
+	}
+	_exit(0);		//exit() would flush stdout, which is the firmware's USART stream
+}
+
+//moves time to the next event, no further than limit, and runs what is due
+static void sim_run(uint64_t limit) {
+	uint64_t next;
+	sim_sync();
+	next = sim_min(sim_next_event(), limit);
+	if (next == SIM_NEVER) {
+		fprintf(stderr, "sim: nothing left to wait for\n");
+		exit(1);
+	}
+	if (next > sim_now) {
+		sim_now = next;
+		sim_pace();
+	}
+	if (sim_now >= sim_end) {
+		sim_finish();
+	}
+	if (sim_now >= sim_script_due) {
+		sim_script_run();
+	}
+	if (sim_now >= sim_release_due) {
+		PORTC.IN |= 0x0F;
+		PORTF.IN |= 0x03;
+		sim_release_due = SIM_NEVER;
+	}
+	if (sim_now >= sim_spi_due) {
+		sim_spi_due = SIM_NEVER;
+		lcd_byte(sim_spi_byte);
+		SPI0.INTFLAGS |= SPI_IF_bm;
+	}
+	if (sim_now >= sim_adc_due) {
+		uint32_t sum = (uint32_t)sim_adc_mv(ADC0.MUXPOS) * 128 / 5;
+		sim_adc_due = SIM_NEVER;
+		ADC0.RES = sum > 0xFFFF ? 0xFFFF : sum;
+		ADC0.COMMAND &= ~ADC_STCONV_bm;
+		ADC0.INTFLAGS |= ADC_RESRDY_bm;
+	}
+	for (uint8_t i = 0; i < 4; i++) {
+		if (sim_now >= sim_tcb[i].due) {
+			sim_tcb[i].due = sim_now + sim_tcb_period(sim_tcb[i].tcb);
+			sim_tcb[i].tcb->INTFLAGS |= TCB_CAPT_bm;
+		}
+	}
+	if (sim_now >= sim_rtc_due) {
+		sim_rtc_base = sim_rtc_due;
+		sim_rtc_due += sim_rtc_period();
+		RTC.INTFLAGS |= RTC_OVF_bm;
+	}
+	if (sim_now >= sim_tca_due) {
+		sim_tca_due += sim_tca_period();
+		TCA0.SINGLE.INTFLAGS |= TCA_SINGLE_OVF_bm;
+	}
+	if (sim_now >= sim_rx_due) {
+		sim_rx_due = sim_now + ((sim_rx_head != sim_rx_tail) ? SIM_USART_NS : SIM_RX_POLL_NS);
+		if (sim_rx_head == sim_rx_tail) {
+			sim_rx_poll();
+		}
+		if (sim_rx_head != sim_rx_tail && !(USART0.STATUS & USART_RXCIF_bm)) {
+			USART0.RXDATAL = sim_rx_buf[sim_rx_tail++];
+			USART0.STATUS |= USART_RXCIF_bm;
+		}
+	}
+	sim_sync();
+	sim_watch_valves();
+
+	//flags are set, run the handlers that are enabled, in vector order
+	if (!sim_i_bit || sim_in_isr) {
+		return;
+	}
+	//INTFLAGS are write one to clear on the chip, the handlers do that
+	//and the sim takes it as done
+	if (RTC.INTCTRL & RTC.INTFLAGS & RTC_OVF_bm) {
+		sim_isr(RTC_CNT_vect);
+		RTC.INTFLAGS = 0;
+	}
+	if ((TCA0.SINGLE.INTCTRL & TCA0.SINGLE.INTFLAGS & TCA_SINGLE_OVF_bm)) {
+		sim_isr(TCA0_OVF_vect);
+		TCA0.SINGLE.INTFLAGS = 0;
+	}
+	for (uint8_t i = 0; i < 4; i++) {
+		TCB_t *tcb = sim_tcb[i].tcb;
+		if (tcb->INTCTRL & tcb->INTFLAGS & TCB_CAPT_bm) {
+			sim_isr(sim_tcb[i].vect);
+			tcb->INTFLAGS = 0;
+		}
+	}
+	if ((USART0.CTRLA & USART_RXCIE_bm) && (USART0.STATUS & USART_RXCIF_bm)) {
+		sim_isr(USART0_RXC_vect);
+	}
+	if ((USART0.CTRLA & USART_DREIE_bm) && (USART0.STATUS & USART_DREIF_bm)) {
+		sim_isr(USART0_DRE_vect);
+	}
+	if ((SPI0.INTCTRL & SPI_IE_bm) && (SPI0.INTFLAGS & SPI_IF_bm)) {
+		sim_isr(SPI0_INT_vect);
+		SPI0.INTFLAGS &= ~SPI_IF_bm;	//the handler reads DATA to clear it
+	}
+	if (ADC0.INTCTRL & ADC0.INTFLAGS & ADC_RESRDY_bm) {
+		sim_isr(ADC0_RESRDY_vect);
+		ADC0.INTFLAGS &= ~ADC_RESRDY_bm;	//the handler reads RES to clear it
+	}
+	if (sim_show_lcd && sim_spi_due == SIM_NEVER && !(TCB0.CTRLA & TCB_ENABLE_bm)) {
+		lcd_show();		//only once the LCD queue has drained
+	}
+}
+
+void hal_idle(void) {
+	sim_run(SIM_NEVER);
+}
+
+//every other call runs the next interrupt, so the read that is retried
+//after one gets through
+void hal_preempt(void) {
+	static uint8_t skip;
+	if (sim_preempt_hook) {
+		sim_preempt_hook();
+		return;
+	}
+	if (!sim_preempt || !sim_i_bit || sim_in_isr) {
+		return;
+	}
+	skip = !skip;
+	if (skip) {
+		sim_preempts++;
+		sim_run(SIM_NEVER);
+	}
+}
+
+void hal_copy(volatile void *to, const volatile void *from, uint8_t len) {
+	for (uint8_t i = 0; i < len; i++) {
+		hal_preempt();
+		((volatile uint8_t *)to)[i] = ((const volatile uint8_t *)from)[i];
+	}
+}
+
+void sim_delay_us(uint32_t us) {
+	uint64_t until = sim_now + (uint64_t)us * 1000;
+	while (sim_now < until) {
+		sim_run(until);
+	}
+}
+
+/* startup *************************************************************/
+
+__attribute__((constructor))
+static void sim_init(void) {
+	const char *env;
+	sim_tcb[0].vect = TCB0_INT_vect;
+	sim_tcb[1].vect = TCB1_INT_vect;
+	sim_tcb[2].vect = TCB2_INT_vect;
+	sim_tcb[3].vect = TCB3_INT_vect;
+	PORTC.IN = 0xFF;			//buttons pulled up
+	PORTF.IN = 0xFF;
+	USART0.STATUS = USART_DREIF_bm;
+	memset(lcd_ddram, ' ', sizeof(lcd_ddram));
+	memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+	clock_gettime(CLOCK_MONOTONIC, &sim_wall_start);
+
+	if ((env = getenv("SIM_SECONDS"))) {
+		sim_end = strtoull(env, NULL, 0) * 1000000000ULL;
+	}
+	if ((env = getenv("SIM_SPEED"))) {
+		sim_speed = strtoul(env, NULL, 0);
+	}
+	if ((env = getenv("SIM_LCD"))) {
+		sim_show_lcd = atoi(env) != 0;
+	}
+	if ((env = getenv("SIM_SOLAR_MV"))) {
+		sim_solar_mv = atoi(env);
+	}
+	if ((env = getenv("SIM_SOLAR_NOISE"))) {
+		sim_solar_noise = atoi(env);
+	}
+	if ((env = getenv("SIM_START_HOUR"))) {
+		sim_start_hour = strtoul(env, NULL, 0) % 24;
+	}
+	if ((env = getenv("SIM_PREEMPT"))) {
+		sim_preempt = atoi(env) != 0;
+	}
+	if ((env = getenv("SIM_EEPROM"))) {
+		sim_eeprom_open(env);
+	}
+	if ((env = getenv("SIM_SCRIPT"))) {
+		sim_script = fopen(env, "r");
+		if (!sim_script) {
+			fprintf(stderr, "sim: cannot open %s: %s\n", env, strerror(errno));
+			exit(1);
+		}
+		sim_script_next();
+	}
+	env = getenv("SIM_PTY");
+	if (!env || atoi(env) != 0) {
+		sim_pty = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (sim_pty < 0 || grantpt(sim_pty) || unlockpt(sim_pty)) {
+			fprintf(stderr, "sim: no pty: %s\n", strerror(errno));
+			exit(1);
+		}
+		fprintf(stderr, "sim: USART0 on %s\n", ptsname(sim_pty));
+	}
+}
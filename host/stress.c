@@ -0,0 +1,232 @@
+/*
+ * stress.c
+ *
+ * Preemption stress test of the state the ISRs and the main loop share
+ * without turning interrupts off, see seqlock.h. main.c is built into it,
+ * its main() renamed, and it is linked with sim.c:
+ *
+ *	gcc -std=gnu99 -O2 -DHAL_HOST -Ihost -o stress host/stress.c host/sim.c
+ *	SIM_PTY=0 ./stress
+ *
+ * Every multi-byte copy to or from shared state goes through HAL_COPY(),
+ * which on the host calls hal_preempt() before each byte, and the seqlock
+ * readers call it once more in seq_read_retry(). Each of these calls is an
+ * access here.
+ *
+ * Readers of state an ISR writes run again and again, with the ISR run at
+ * their first access, then at their second one and so on until a run ends
+ * before the ISR got its turn. The value the reader returns must be wholly
+ * the one from before the ISR or the one after it. The values differ in
+ * every byte, so a reader that copies them without its sequence lock sees
+ * a mix of the two.
+ *
+ * Writers of a double buffered copy an ISR reads run once, and at every
+ * access the copy the ISR would read is checked: wholly the old values
+ * while the index still points at it, wholly the new ones after the flip.
+ *
+ * Prints a line per check and exits non-zero if one fails.
+ */
+
+#define main firmware_main
+#include "../main.c"
+#undef main
+
+static uint16_t stress_at;				//access the ISR runs at, from 1
+static uint16_t stress_access;			//accesses so far
+static void (*stress_isr)(void);		//run at access stress_at
+static void (*stress_probe)(void);		//run at every access when set
+static uint8_t stress_failed;
+
+static void stress_hook(void) {
+	if (stress_probe) {
+		stress_probe();
+		return;
+	}
+	if (++stress_access == stress_at) {
+		stress_isr();
+	}
+}
+
+//runs read with isr at every access in turn, returns the number of runs
+//that gave neither before nor after
+static uint16_t stress_reader(const char *name, void (*setup)(void), void (*isr)(void),
+							  uint32_t (*read)(void), uint32_t before, uint32_t after) {
+	uint16_t torn = 0;
+	uint32_t got;
+	stress_isr = isr;
+	for (stress_at = 1; ; stress_at++) {
+		setup();
+		stress_access = 0;
+		got = read();
+		if (got != before && got != after) {
+			if (!torn) {
+				printf("  %s: ISR at access %u read %08lX, not %08lX or %08lX\n", name,
+					   stress_at, (unsigned long)got, (unsigned long)before, (unsigned long)after);
+			}
+			torn++;
+		}
+		if (stress_access < stress_at) {
+			break;
+		}
+	}
+	printf("%s: %s, ISR at %u accesses\n", name, torn ? "FAILED" : "ok", stress_at - 1);
+	stress_failed |= torn != 0;
+	return torn;
+}
+
+/* clock.h **************************************************************/
+
+static void clock_setup(void) {
+	clock_seconds = 0x00FFFFFF;
+	RTC.CNT = CLOCK_HZ - 1;
+	RTC.INTFLAGS = 0;
+}
+
+//the second overflows, CNT starts over and the ISR counts it
+static void clock_isr(void) {
+	RTC.CNT = 0;
+	RTC_CNT_vect();
+	RTC.INTFLAGS = 0;
+}
+
+/* ADC_diagnostic.h *****************************************************/
+
+static void adc_setup(void) {
+	adc_channel = BOARD_AIN_FILL - ADC_FIRST_CHANNEL;
+	adc_latest[adc_channel] = 0x00FF;
+	ADC0.RES = 0xFF00;
+}
+
+static uint32_t adc_read_fill(void) {
+	return adc_read_sum(BOARD_AIN_FILL);
+}
+
+/* USART_config.h *******************************************************/
+
+//the receive buffer is full, the next byte is an overrun
+static void usart_setup(void) {
+	usart_rx_overrun = 0x00FF;
+	usart_rx_tail = 0;
+	usart_rx_head = USART_RX_SIZE - 1;
+}
+
+static uint32_t usart_read_overruns(void) {
+	return usart_rx_overruns();
+}
+
+/* telemetry.h **********************************************************/
+
+static void telemetry_setup(void) {
+	telemetry_capture(0, 0x00FF, 0x00FF, 0x00FF, 'a');
+}
+
+static void telemetry_isr(void) {
+	telemetry_capture(1, 0xFF00, 0xFF00, 0xFF00, 'b');
+}
+
+//the snapshot folded into one value, the 16 bit fields each count once
+static uint32_t telemetry_read(void) {
+	telemetry_snapshot_t snap;
+	uint32_t sum;
+	telemetry_snap_read(&snap);
+	sum = (uint32_t)snap.second_counter + snap.clean_time + snap.delay_end;
+	if (snap.second_counter != snap.clean_time || snap.clean_time != snap.delay_end
+		|| snap.mode != 'a' + snap.zone) {
+		sum = 0xDEADBEEF;			//fields from both snapshots
+	}
+	return sum;
+}
+
+/* double buffered copies ***********************************************/
+
+static uint8_t stress_cur;				//index before the writer ran
+static uint32_t stress_probes;
+
+static void sched_probe(void) {
+	volatile sched_next_t *next = &sched_next[sched_next_cur];
+	uint32_t at = sched_next_cur == stress_cur ? 0x00FFFFFF : 0xFF000000;
+	uint8_t armed = sched_next_cur == stress_cur ? 0 : 1;
+	stress_probes++;
+	if (next->at != at || next->armed != armed) {
+		printf("  sched_publish: ISR read %08lX armed %u at access %lu\n",
+			   (unsigned long)next->at, next->armed, (unsigned long)stress_probes);
+		stress_failed |= 2;
+	}
+}
+
+static void sched_check(void) {
+	sched_next[sched_next_cur].at = 0x00FFFFFF;
+	sched_next[sched_next_cur].armed = 0;
+	sched_next[!sched_next_cur].at = 0x12345678;
+	sched_next[!sched_next_cur].armed = 0;
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		sched_queue[zone][0].at = 0xFF000000 + zone;
+	}
+	stress_cur = sched_next_cur;
+	stress_probes = 0;
+	stress_probe = sched_probe;
+	sched_publish();
+	stress_probe = 0;
+	sched_probe();
+	if (sched_next_cur == stress_cur) {
+		printf("  sched_publish: no flip\n");
+		stress_failed |= 2;
+	}
+	printf("sched_publish: %s, ISR at %lu accesses\n", stress_failed & 2 ? "FAILED" : "ok",
+		   (unsigned long)stress_probes - 1);
+}
+
+static void zone_probe(void) {
+	volatile telemetry_zone_t *status = telemetry_zones[telemetry_zones_cur];
+	uint8_t flipped = telemetry_zones_cur != stress_cur;
+	stress_probes++;
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		if (status[zone].cycle_start != (flipped ? 0xFF000000 : 0x00FFFFFF)
+			|| status[zone].delay_end != (flipped ? 0xFF000000 : 0x00FFFFFF)
+			|| status[zone].clean_time != (flipped ? 0xFF00 : 0x00FF)
+			|| status[zone].mode != (flipped ? zone_mode(zone) : '?')) {
+			printf("  zone_publish: ISR read zone %u cycle_start %08lX at access %lu\n", zone,
+				   (unsigned long)status[zone].cycle_start, (unsigned long)stress_probes);
+			stress_failed |= 4;
+		}
+	}
+}
+
+static void zone_check(void) {
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		telemetry_zones[telemetry_zones_cur][zone].cycle_start = 0x00FFFFFF;
+		telemetry_zones[telemetry_zones_cur][zone].delay_end = 0x00FFFFFF;
+		telemetry_zones[telemetry_zones_cur][zone].clean_time = 0x00FF;
+		telemetry_zones[telemetry_zones_cur][zone].mode = '?';
+		cycle_start[zone] = 0xFF000000;
+		zone_delay_end[zone] = 0xFF000000;
+		clean_time[zone] = 0xFF00;
+	}
+	stress_cur = telemetry_zones_cur;
+	stress_probes = 0;
+	stress_probe = zone_probe;
+	zone_publish();
+	stress_probe = 0;
+	zone_probe();
+	if (telemetry_zones_cur == stress_cur) {
+		printf("  zone_publish: no flip\n");
+		stress_failed |= 4;
+	}
+	printf("zone_publish: %s, ISR at %lu accesses\n", stress_failed & 4 ? "FAILED" : "ok",
+		   (unsigned long)stress_probes - 1);
+}
+
+int main(void) {
+	sim_preempt_hook = stress_hook;
+	stress_reader("clock_now", clock_setup, clock_isr, clock_now, 0x00FFFFFF, 0x01000000);
+	//the tick count wraps, from FFFFFFFF to 0
+	stress_reader("clock_ticks", clock_setup, clock_isr, clock_ticks,
+				  (uint32_t)(0x00FFFFFFUL * CLOCK_HZ + CLOCK_HZ - 1), (uint32_t)(0x01000000UL * CLOCK_HZ));
+	stress_reader("adc_read_sum", adc_setup, ADC0_RESRDY_vect, adc_read_fill, 0x00FF, 0xFF00);
+	stress_reader("usart_rx_overruns", usart_setup, USART0_RXC_vect, usart_read_overruns, 0x00FF, 0x0100);
+	stress_reader("telemetry_snap_read", telemetry_setup, telemetry_isr, telemetry_read,
+				  3 * 0x00FF, 3 * 0xFF00);
+	sched_check();
+	zone_check();
+	return stress_failed;
+}
@@ -0,0 +1,23 @@
+/*
+ * atomic.h
+ *
+ * Host stand-in for <util/atomic.h>. The block clears the simulated I bit
+ * and puts it back on the way out, like the avr-libc version.
+ */
+
+
+#ifndef HOST_UTIL_ATOMIC_H_
+#define HOST_UTIL_ATOMIC_H_
+
+#include <stdint.h>
+
+uint8_t sim_irq_save(void);
+void sim_irq_restore(const uint8_t *sreg);
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) \
+	for (uint8_t sim_sreg_save __attribute__((__cleanup__(sim_irq_restore))) = sim_irq_save(), \
+		sim_todo = 1; sim_todo; sim_todo = 0)
+
+#endif /* HOST_UTIL_ATOMIC_H_ */
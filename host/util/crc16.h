@@ -0,0 +1,21 @@
+/*
+ * crc16.h
+ *
+ * Host stand-in for <util/crc16.h>, C versions of the avr-libc routines.
+ */
+
+
+#ifndef HOST_UTIL_CRC16_H_
+#define HOST_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+	crc ^= (uint16_t)data << 8;
+	for (uint8_t i = 0; i < 8; i++) {
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+#endif /* HOST_UTIL_CRC16_H_ */
@@ -0,0 +1,19 @@
+/*
+ * delay.h
+ *
+ * Host stand-in for <util/delay.h>. Delays move simulated time on, handlers
+ * keep running meanwhile when the I bit is set.
+ */
+
+
+#ifndef HOST_UTIL_DELAY_H_
+#define HOST_UTIL_DELAY_H_
+
+#include <stdint.h>
+
+void sim_delay_us(uint32_t us);
+
+#define _delay_us(us) sim_delay_us((uint32_t)(us))
+#define _delay_ms(ms) sim_delay_us((uint32_t)(ms) * 1000UL)
+
+#endif /* HOST_UTIL_DELAY_H_ */
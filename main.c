@@ -3,359 +3,319 @@
 #include <avr/io.h>
 #include <string.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 #include <stdio.h>
+#include <util/crc16.h>
+#include "hal.h"
+#include "seqlock.h"
+#include "board.h"
+#include "profile.h"
+#include "clock.h"
 #include "DOG204_LCD.h"
 #include "USART_config.h"
+#include "valve.h"
 #include "ADC_diagnostic.h"
+#include "telemetry.h"
+#include "debounce.h"
+#include "zone.h"
+#include "schedule.h"
+#include "night.h"
+#include "screens.h"
+#include "fsm.h"
+#include "config.h"
+#include "eventlog.h"
+#include "boot.h"
+#include "protocol.h"
 
-void start_fill(void);
-void start_clean(void);
-void cancel_fill(void);
-void cancel_clean(void);
+void fsm_dispatch(uint8_t event);
+void zone_dispatch(uint8_t zone, uint8_t event);
+void zone_select(uint8_t zone);
+char zone_mode(uint8_t zone);
+void restart_cycle(uint16_t seconds);
+void zone_publish(void);
 
+//per zone state is indexed by the zone, the FSM actions use zone_cur, see zone.h
 char IPAdd[21];
-uint16_t second_counter = 0;	//keeps track of seconds
-uint16_t clean_time = 10800;	//time when a clean event occurs
-uint16_t delay_end = 0;			//end of an event
-const uint8_t fill_delay = 45;	//duration of fill event
-uint8_t topOff_fill_delay = 20; //duration of top off fill 
-const uint8_t clean_delay = 45;	//duration of clean event
-int night_mode = 0;				//1 means that night mode is on and 0 mean that it is off
-int clean = 0;					//1 means that a clean event was right before the fill event
-int disabled = 0;				//1 means system was previously disabled before fill event
-int resetFill = 0;				//1 means the fill cycle was an external fill and
-								//second_counter should be reset to 0
-char mode = 'h';				//stores 'state' of the system 
+uint32_t cycle_start[ZONES];	//clock_seconds when the fill/clean cycle started
+uint16_t clean_time[ZONES] = {[0 ... ZONES - 1] = 10800};	//seconds into the cycle when a clean event occurs
+const uint16_t fill_delay = 45000;	//duration of fill event in ms
+uint16_t topOff_fill_delay[ZONES] = {[0 ... ZONES - 1] = 20000}; //duration of top off fill in ms
+const uint16_t clean_delay = 45000;	//duration of clean event in ms
+const uint16_t clean_bb2_delay = 15000;	//BB2 closes this many ms into a clean
+#define TOPOFF_MIN_MS 100		//limits of topOff_fill_delay
+#define TOPOFF_MAX_MS 65000
+int night_mode = 0;				//1 means that night mode is on and 0 mean that it is off,
+								//one setting for all zones, they share the solar panel
+uint8_t clean[ZONES];			//1 means that a clean event was right before the fill event
+uint8_t disabled[ZONES];		//1 means system was previously disabled before fill event
+uint8_t resetFill[ZONES];		//1 means the fill cycle was an external fill and
+								//the cycle should restart from 0
+uint8_t fsm_state[ZONES] = {[0 ... ZONES - 1] = ST_HOME};	//state of each zone, see fsm.h
+char mode = 'h';				//screen letter of the state of zone_sel
+uint8_t fsm_cause = EVLOG_CAUSE_NONE;	//EVLOG_CAUSE_* of the event being dispatched
 
-//***************************************************************************
-//
-// Function Name        : "PORTC ISR"
-// Date                 : 9/20/21
-// Version              : 1.0
-// Target MCU           : AVR128DB48
-// Target Hardware      : Push Button
-// Author               : Brandon Guzy & Vanessa Li
-// DESCRIPTION
-// Interrupt service routine for port C, handles button presses in different
-// modes. For each mode, buttons are assigned different functions like switching
-// to another screen or triggering actions like a fill/clean
-//
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
-//
-// Revision History     : v1.1 Added additional mode options
-//						  v1.2 Changed PORTB to PORTC
-//**************************************************************************
-ISR(PORTC_PORT_vect){
-	_delay_ms(20); //delay to make sure the pushbutton was actually pressed
-	switch(mode){
-		case 'h'://home menu
-		switch(PORTC.IN & 0x0F){
-			case 0b00001110:	//mode menu
-			mode = 'm';
-			break;
-			case 0b00001101:	//diagnostic menu
-			mode = 'a';
-			break;
-			case 0b00001011:	//schedule clean cycles menu
-			mode = 'l';
-			break;
-			case 0b00000111:	//schedule fill cycles menu
-			mode = 'i';
-			break;
-		}
-		break;
-		case 'm': //mode menu
-		switch(PORTC.IN & 0x0F){
-			case 0b00001110:	//disable system menu
-			mode = 'e';
-			break;
-			case 0b00001101:	//enable night-mode menu
-			mode = 'n';
-			break;
-			case 0b00000111:	//home button
-			mode = 'h';
-			break;
-		}
-		break;
-		case 'e'://disable system menu
-		switch(PORTC.IN & 0x0F){
-			case 0b00001110:	//yes to disable mode
-			mode = 'd';
-			break;
-			case 0b00001101:	//no to disable mode
-			mode = 'm';
-			break;
-		}
-		break;
-		case 'd'://menu that shows "SYSTEM DISABLED"
-		switch(PORTC.IN & 0x0F){
-			case 0b00000111:	//enable system
-			mode = 'h';
-			break;
-		}
-		break;
-		case 'n'://enable night-mode menu
-		if(night_mode == 1) {
-			switch(PORTC.IN & 0x0F){
-				case 0b00001110:	//yes to turn off night mode
-				night_mode = 0;
-				mode = 'h';
-				break;
-				case 0b00001101:	//no to turn off night mode
-				mode = 'm';
-				break;
-			}	
-		}else {
-			switch(PORTC.IN & 0x0F){
-				case 0b00001110:	//yes to turn on night mode
-				night_mode = 1;
-				mode = 'h';
-				break;
-				case 0b00001101:	//no to turn on night mode
-				mode = 'm';
-				break;
-			}
-		}
-		break;
-		case 'l'://schedule clean menu
-		switch(PORTC.IN & 0x0F){
-			case 0b00001110:	//increment fills per clean
-			if(clean_time < 63000)	//cannot overflow, max 18 hour clean time
-				clean_time += 3600; //
-			break;
-			case 0b00001101:	//decrement fills per clean
-			if(clean_time > 10800)// cannot go under 2 fills per clean
-				clean_time -= 3600;
-			break;
-			case 0b00001011:	//start clean cycle
-			start_clean();
-			break;
-			case 0b00000111:	//home button
-			if(second_counter > clean_time) {
-				clean_time = clean_time + 3600;
-			}
-			mode = 'h';
-			break;
-		}
-		break;
-		case 'i'://schedule fill menu (duration of top-off fill)
-		switch(PORTC.IN & 0x0F){
-			case 0b00001110:	//increment by 1 second
-				topOff_fill_delay += 1;
-			break;
-			case 0b00001101:	//decrement by 1 second
-			if(topOff_fill_delay > 1) //cannot go below 1 second
-				topOff_fill_delay -= 1;
-			break;
-			case 0b00001011:	//home button
-				mode = 'h';
-			break;
-			case 0b00000111:	//start fill cycle
-				resetFill = 1;
-				start_fill();
-			break;
-		}
-		break;
-		case 'f'://fill menu
-			cancel_fill();
-		break;
-		case 'c'://clean menu
-			cancel_clean();
-		break;
-		case 'a': //diagnostics menu
-		switch(PORTC.IN & 0x0F){
-			case 0b00000111:	//home button
-			mode = 'h';
-			break;
-		}
-		break;
-		case 'g': //night-mode menu
-		switch(PORTC.IN & 0x0F){
-			case 0b00000111:   //disable night mode
-			night_mode = 0;
-			mode = 'h';
-			break;
-		}
-		break;	
-	}
-	PORTC_INTFLAGS = 0xFF;	//clear interrupt flags
-}
+//command verb hash for execute_USART_command, from the first and last
+//letter and the length of the verb. Every verb must hash to a different
+//value, two verbs that clash are a duplicate case label and do not compile
+#define CMD_HASH(first, last, len) (((first) + ((last) << 1) + (len)) & 0x1F)
 
 //***************************************************************************
 //
 // Function Name        : "execute_USART_command"
 // Date                 : 12/5/21
-// Version              : 1.0
+// Version              : 1.2
 // Target MCU           : AVR128DB48
 // Target Hardware      ; none
 // Author               : Brandon Guzy
 // DESCRIPTION
 // This takes a string as an input and executes commands based on what
-// the string is. Meant to be used in conjunction with the USART recieve
-// interrupt
+// the string is. Meant to be used in conjunction with USART0_rx_task. The
+// verb runs up to the first space or colon, the rest is its argument.
+// Commands that are not known are ignored. fill, clean, disable and cancel
+// go to zone_sel, or to the zone given as their argument, from 1.
 //
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
+// Warnings             : The string is changed, the separator after the
+//						  verb is overwritten
+// Restrictions         : Must not be called from an interrupt, it runs FSM
+//						  actions and prints
+// Algorithms           : The verb is hashed and switched on, the switch
+//						  compiles to a jump table and one strcmp_P confirms
+//						  the verb, so dispatch does not grow with the
+//						  number of commands
+// References           : USART0_rx_task()
 //
 // Revision History     : Initial version
+//						  v1.1 Hashed verb dispatch, run from the main loop
+//						  v1.2 Zones
 //
 //**************************************************************************
 void execute_USART_command(char myCommand[]){
-	if(!strcmp(myCommand, "fill")){
-		resetFill = 1;
-		start_fill();
-	}else if(!strcmp(myCommand, "clean")){
-		start_clean();
-	}else if(!strcmp(myCommand, "disable")){
-		mode = 'd';
-	}else if(!strncmp(myCommand, "IP:", 3)){
-		strcpy(IPAdd, myCommand);
-	}else if(!strcmp(myCommand, "cancel")){
-		if (mode == 'c') {
-			cancel_clean();
-		}else if(mode == 'd'){
-			mode = 'h';		//turn off disabled mode
-		}else if (mode == 'f') {
-			cancel_fill();	
+	uint8_t len = 0;
+	char separator;
+	char *arg;
+	uint8_t zone;
+	
+	while(myCommand[len] != '\0' && myCommand[len] != ' ' && myCommand[len] != ':') {
+		len++;
+	}
+	if(len == 0) {
+		return;
+	}
+	separator = myCommand[len];
+	myCommand[len] = '\0';
+	arg = separator ? &myCommand[len + 1] : &myCommand[len];
+	
+	//zone named by the argument, ZONES if it names none
+	zone = ZONES;
+	if(!*arg)
+		zone = zone_sel;
+	else if(arg[0] >= '1' && arg[0] < '1' + ZONES && !arg[1])
+		zone = arg[0] - '1';
+	
+	lcd_dirty = 1;
+	switch(CMD_HASH((uint8_t)myCommand[0], (uint8_t)myCommand[len - 1], len)) {
+	case CMD_HASH('f', 'l', 4):
+		if(!strcmp_P(myCommand, PSTR("fill")) && zone < ZONES)
+			zone_dispatch(zone, EV_CMD_FILL);
+		break;
+	case CMD_HASH('c', 'n', 5):
+		if(!strcmp_P(myCommand, PSTR("clean")) && zone < ZONES)
+			zone_dispatch(zone, EV_CMD_CLEAN);
+		break;
+	case CMD_HASH('d', 'e', 7):
+		if(!strcmp_P(myCommand, PSTR("disable")) && zone < ZONES)
+			zone_dispatch(zone, EV_CMD_DISABLE);
+		break;
+	case CMD_HASH('c', 'l', 6):
+		if(!strcmp_P(myCommand, PSTR("cancel")) && zone < ZONES)
+			zone_dispatch(zone, EV_CMD_CANCEL);	//ends a fill, clean or disabled mode
+		break;
+	case CMD_HASH('z', 'e', 4):
+		if(strcmp_P(myCommand, PSTR("zone")))
+			break;
+		if(zone < ZONES)
+			zone_select(zone);		//shows it on the LCD, no argument keeps it
+		printf("zone=%u of %u\n", zone_sel + 1, ZONES);
+		break;
+	case CMD_HASH('I', 'P', 2):
+		if(!strcmp_P(myCommand, PSTR("IP")) && separator == ':') {
+			myCommand[len] = ':';		//the screen shows the whole "IP:..." line
+			strncpy(IPAdd, myCommand, sizeof(IPAdd) - 1);
 		}
+		break;
+	case CMD_HASH('t', 'm', 5):
+		if(strcmp_P(myCommand, PSTR("telem")))
+			break;
+		if(!strcmp_P(arg, PSTR("text")))
+			telemetry_text = 1;		//old text lines for bench debugging
+		else if(!strcmp_P(arg, PSTR("bin")))
+			telemetry_text = 0;
+		break;
+	case CMD_HASH('p', 'f', 4):
+		if(strcmp_P(myCommand, PSTR("prof")))
+			break;
+		if(!*arg)
+			prof_dump();
+		else if(!strcmp_P(arg, PSTR("reset")))
+			prof_reset();
+		break;
+	case CMD_HASH('f', 's', 6):
+		if(!strcmp_P(myCommand, PSTR("frames")) && !*arg)
+			printf("rendered=%u skipped=%u bytes=%u\n", lcd_frames_rendered, lcd_frames_skipped, lcd_frame_bytes);
+		break;
+	case CMD_HASH('l', 'g', 3):
+		if(!strcmp_P(myCommand, PSTR("log")) && !*arg)
+			evlog_dump();
+		break;
+	case CMD_HASH('v', 'e', 5):
+		if(!strcmp_P(myCommand, PSTR("valve")) && !*arg)
+			printf("valves a=%02X d=%02X trips=%u\n", valve_on_a, valve_on_d, valve_lock_trips);
+		break;
+	case CMD_HASH('b', 't', 4):
+		if(!strcmp_P(myCommand, PSTR("boot")) && !*arg)
+			printf("ready=%lums post=%02X\n", (unsigned long)(boot_ready_ticks * 1000 / CLOCK_HZ), post_result);
+		break;
+	case CMD_HASH('l', 'k', 4):
+		if(!strcmp_P(myCommand, PSTR("link")) && !*arg)
+			printf("tx_full=%u tx_dropped=%u rx_overrun=%u rx_long=%u bad_frames=%u\n", usart_tx_full, usart_tx_dropped, usart_rx_overruns(), usart_rx_long, proto_bad_frames);
+		break;
 	}
 }
 
-//***************************************************************************
-//
-// Function Name        : "PORTF ISR"
-// Date                 : 12/07/21
-// Version              : 1.0
-// Target MCU           : AVR128DB48
-// Target Hardware      : Push Button
-// Author               : Vanessa Li
-// DESCRIPTION
-// Interrupt service routine for port F, handles button presses for the 
-// external pushbuttons. PIN1 performs a clean and PIN0 performs a fill.
-//
-// Warnings             : none
-// Restrictions         : none
-// Algorithms           : none
-// References           : none
-//
-// Revision History     :
-//
-//**************************************************************************
-ISR(PORTF_PORT_vect){
-	_delay_ms(20);
-	switch(PORTF.IN & 0b00000011){
-			case 0b00000001:	//external clean
-				if(mode == 'c') {
-					cancel_clean();		//if currently cleaning, cancel if button is pressed
-				}else if(mode == 'f') { //if currently filling, cancel fill if button is pressed
-					cancel_fill();		
-				}else {
-					start_clean();		
-				}
-			break;
-			case 0b00000010:	//external fill
-				if(mode == 'f') {
-					cancel_fill();
-				}else {
-					resetFill = 1;
-					start_fill();
-				}
-			break;
-		}
+//LCD button presses to events, a single button maps to its key
+const uint8_t key_events[16] PROGMEM = {
+	EV_NONE, EV_KEY0, EV_KEY1, EV_KEY_MULTI,
+	EV_KEY2, EV_KEY_MULTI, EV_KEY_MULTI, EV_KEY_MULTI,
+	EV_KEY3, EV_KEY_MULTI, EV_KEY_MULTI, EV_KEY_MULTI,
+	EV_KEY_MULTI, EV_KEY_MULTI, EV_KEY_MULTI, EV_KEY_MULTI,
+};
 
-	PORTF_INTFLAGS = 0xFF;	//clear interrupt flags
-}
+//external button presses to events, both at once does nothing
+const uint8_t ext_events[4] PROGMEM = {
+	EV_NONE, EV_EXT_FILL, EV_EXT_CLEAN, EV_NONE,
+};
+
+//what an event came from, for the event log
+const uint8_t event_causes[FSM_EVENTS] PROGMEM = {
+	[EV_KEY0] = EVLOG_CAUSE_BUTTON,
+	[EV_KEY1] = EVLOG_CAUSE_BUTTON,
+	[EV_KEY2] = EVLOG_CAUSE_BUTTON,
+	[EV_KEY3] = EVLOG_CAUSE_BUTTON,
+	[EV_KEY_MULTI] = EVLOG_CAUSE_BUTTON,
+	[EV_EXT_CLEAN] = EVLOG_CAUSE_BUTTON,
+	[EV_EXT_FILL] = EVLOG_CAUSE_BUTTON,
+	[EV_SCHED_FILL] = EVLOG_CAUSE_SCHEDULE,
+	[EV_SCHED_CLEAN] = EVLOG_CAUSE_SCHEDULE,
+	[EV_CMD_FILL] = EVLOG_CAUSE_USART,
+	[EV_CMD_CLEAN] = EVLOG_CAUSE_USART,
+	[EV_CMD_DISABLE] = EVLOG_CAUSE_USART,
+	[EV_CMD_CANCEL] = EVLOG_CAUSE_USART,
+	[EV_TIMEOUT] = EVLOG_CAUSE_TIMER,
+	[EV_DARK] = EVLOG_CAUSE_SOLAR,
+	[EV_LIGHT] = EVLOG_CAUSE_SOLAR,
+};
 
 //***************************************************************************
 //
-// Function Name        : "TCA0_init"
-// Date                 : 10/16/21
-// Version              : 1.0
+// Function Name        : "button_task"
+// Date                 : 10/17/26
+// Version              : 1.2
 // Target MCU           : AVR128DB48
-// Target Hardware      ; none
+// Target Hardware      : Push Button
 // Author               : Vanessa Li
 // DESCRIPTION
-// This program initializes the TCA0 
+// Called from the main loop. Takes the presses latched by the debouncer and
+// dispatches them to the state machine as key and external button events.
+// While the POST results are on screen an LCD button only clears them.
+// The buttons work on the zone on the LCD.
 //
 // Warnings             : none
 // Restrictions         : none
 // Algorithms           : none
-// References           : none
-//
-// Revision History     : Initial version
-//
+// References           : button_take_presses(), fsm_dispatch()
+//
+// Revision History     : Initial version
+//						  v1.1 Presses are looked up as events instead of
+//								handled per mode
+//						  v1.2 Clears the POST screen
+//
 //**************************************************************************
-void TCA0_init(void)
-{
- /* enable overflow interrupt */
- TCA0.SINGLE.INTCTRL = TCA_SINGLE_OVF_bm;
- /* set Normal mode */
- TCA0.SINGLE.CTRLB = TCA_SINGLE_WGMODE_NORMAL_gc;
- /* disable event counting */
- TCA0.SINGLE.EVCTRL &= ~(TCA_SINGLE_CNTAEI_bm); 
- /* set the period */
- TCA0.SINGLE.PER = 15624;
- /* set clock source (sys_clk/256) */
- TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV256_gc 
-                    | TCA_SINGLE_ENABLE_bm; /* start timer */
+void button_task(void){
+	uint8_t presses = button_take_presses();
+	if(presses) {
+		lcd_dirty = 1;
+	}
+	if((presses & BUTTON_LCD_gm) && boot_stage == BOOT_SHOW) {
+		boot_stage = BOOT_DONE;
+		presses &= ~BUTTON_LCD_gm;
+	}
+	if(presses & BUTTON_LCD_gm) {
+		zone_dispatch(zone_sel, pgm_read_byte(&key_events[presses & BUTTON_LCD_gm]));
+	}
+	if(presses & BUTTON_EXT_gm) {
+		zone_dispatch(zone_sel, pgm_read_byte(&ext_events[(presses & BUTTON_EXT_gm) >> BUTTON_EXT_gp]));
+	}
 }
+
 //***************************************************************************
 //
-// Function Name        : "TCA0 ISR"
+// Function Name        : "RTC ISR"
 // Date                 : 10/16/21
-// Version              : LED
+// Version              : 1.5
 // Target MCU           : AVR128DB48
-// Target Hardware      ; none
+// Target Hardware      ; RTC
 // Author               : Vanessa Li
 // DESCRIPTION
-// Increments seconds counter and sends strings to USART0 using printf.
+// Runs on the RTC overflow once a second. Increments the clock, flags
+// scheduled events that came due, marks the screen for a redraw and takes
+// a snapshot of the schedule state, telemetry_task() sends it to USART0
+// from the main loop. With several zones each second has the next zone.
 //
 // Warnings             : none
 // Restrictions         : none
 // Algorithms           : none
-// References           : none
+// References           : telemetry_capture(), sched_tick()
 //
 // Revision History     : Initial version
+//						  v1.1 Moved the printf calls out to telemetry_task()
+//						  v1.2 Fires events from the schedule queue
+//						  v1.3 Moved from TCA0 to the RTC, 32 bit clock
+//						  v1.4 Snapshots take turns between the zones
+//						  v1.5 Reads the zones from the copy zone_publish()
+//								hands over, clock_seq around the increment
 //
 //**************************************************************************
-ISR(TCA0_OVF_vect) {
-	second_counter += 0x01; // increment seconds counter 
-	
-	if(TCA0_SINGLE_PER > 10000){
-	 printf("second_counter=%d\n", second_counter);
-	 printf("clean_time=%d\n", clean_time);
-	 printf("delay_end=%d\n", delay_end);
-	 printf("mode=%c\n", mode);
-	}else if(second_counter%30 == 0){
-	printf("second_counter=%d\n", second_counter);
-	 printf("clean_time=%d\n", clean_time);
-	 printf("delay_end=%d\n", delay_end);
-	 printf("mode=%c\n", mode);
-	}else if(mode == 'd'){
-	 printf("mode=%c\n", mode);
-	}
-	 
-	TCA0.SINGLE.INTFLAGS = TCA_SINGLE_OVF_bm; //clear interrupt flags
+ISR(RTC_CNT_vect) {
+	static uint8_t zone = 0;
+	volatile telemetry_zone_t *status = &telemetry_zones[telemetry_zones_cur][zone];
+	uint32_t now;
+	PROF_BEGIN(PROF_TICK);
+	seq_write(&clock_seq);
+	now = ++clock_seconds;
+	seq_write(&clock_seq);
+	sched_tick(now);
+	lcd_dirty = 1;	//times on screen move on
+	telemetry_capture(zone, now - status->cycle_start, status->clean_time, status->delay_end - status->cycle_start, status->mode);
+	if(++zone >= ZONES)
+		zone = 0;
+	RTC.INTFLAGS = RTC_OVF_bm; //clear interrupt flags
+	PROF_END(PROF_TICK);
 }
 
+
 //***************************************************************************
 //
 // Function Name        : "port_init"
 // Date                 : 9/30/21
-// Version              : 1.2
+// Version              : 1.5
 // Target MCU           : AVR128DB48
 // Target Hardware      ; Push Button
 // Author               : Brandon Guzy
 // DESCRIPTION
-// This program sets up the ports of the AVR128DB28 as inputs, enables 
-// pull ups, and interrupts. At the end of the subroutine, interrupts are
-// enabled
+// This program sets up the ports of the AVR128DB28 as inputs and enables 
+// pull ups. The buttons are polled by the debouncer, so no pin interrupts
+// are enabled.
 //
 // Warnings             : none
 // Restrictions         : none
@@ -366,230 +326,642 @@ ISR(TCA0_OVF_vect) {
 //							after initialization
 //						  v1.2 Updated to interrupt on falling edge to prevent
 //								many interrupts when holding button
+//						  v1.3 Pin interrupts removed, buttons are debounced
+//								from TCB1
+//						  v1.4 No longer waits for the pull ups, boot_task()
+//								holds the buttons off until they settle
+//						  v1.5 SSR outputs of every zone
+//						  v1.6 Pins from board.h
 //
 //**************************************************************************
 void port_init(void){
-	PORTC.DIR &= 0xF0; //C0-3, inputs for LCD pushbuttons
-	PORTA.DIR |= 0b00001100; //A2-3, outputs for SSR enables(fill,clean)
-	PORTD.DIR |= 0b10000010; //D7, output for SSR enable(BB2) and D1, output for ENAC-
-	PORTF.DIR &= 0b11111100; //F0-1, inputs for external pushbuttons
-
-	PORTF.PIN0CTRL = 0b00001011; //enable pull up and interrupt on falling edge
-	PORTF.PIN1CTRL = 0b00001011; //enable pull up and interrupt on falling edge
-	PORTC.PIN0CTRL = 0b00001011; //enable pull up and interrupt on falling edge
-	PORTC.PIN1CTRL = 0b00001011; //enable pull up and interrupt on falling edge
-	PORTC.PIN2CTRL = 0b00001011; //enable pull up and interrupt on falling edge
-	PORTC.PIN3CTRL = 0b00001011; //enable pull up and interrupt on falling edge
-	_delay_ms(50);			//wait for pull ups and interrupts to fully enable
-	
-	PORTC_INTFLAGS = 0xFF;	//clear accidental interrupt flags
-}
-
-//during a fill, fill valve and BB2 valve are open 
+	board_pullups(&BOARD_KEYS_PORT, BOARD_KEYS_gm); //inputs for LCD pushbuttons
+	zone_init(); //outputs for the SSR enables of every zone and ENAC-
+	board_pullups(&BOARD_EXT_PORT, BOARD_EXT_gm); //inputs for external pushbuttons
+}
+
+//screen letter of the state of a zone
+char zone_mode(uint8_t zone) {
+	return pgm_read_byte(&fsm_states[fsm_state[zone] - FSM_FIRST_STATE].screen);
+}
+
+//shows a zone on the LCD and points the commands at it
+void zone_select(uint8_t zone) {
+	zone_sel = zone;
+	mode = zone_mode(zone);
+	lcd_dirty = 1;
+}
+
+//hands the state of every zone the tick ISR reports to it, once per main
+//loop pass. The ISR reads its own copy, so the main loop changes the state
+//with interrupts on.
+void zone_publish(void) {
+	volatile telemetry_zone_t *next = telemetry_zones_next();
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		HAL_COPY(next[zone].cycle_start, cycle_start[zone]);
+		HAL_COPY(next[zone].delay_end, zone_delay_end[zone]);
+		HAL_COPY(next[zone].clean_time, clean_time[zone]);
+		next[zone].mode = zone_mode(zone);
+		hal_preempt();
+	}
+	telemetry_zones_flip();
+}
+
+//seconds into the current cycle of zone_cur
+uint32_t cycle_time(void) {
+	return clock_now() - cycle_start[zone_cur];
+}
+
+//moves the start of the cycle of zone_cur so that it is seconds in now, and
+//has its schedule queue rebuilt
+void restart_cycle(uint16_t seconds) {
+	uint32_t start = clock_now() - seconds;
+	if(start != cycle_start[zone_cur]) {
+		cycle_start[zone_cur] = start;
+		sched_dirty |= 1 << zone_cur;
+	}
+}
+
+//reads a parameter of zone_cur for a binary request, see PROTO_PARAM_* in
+//protocol.h
+uint8_t proto_param_get(uint8_t param, uint16_t *value) {
+	switch(param) {
+	case PROTO_PARAM_CLEAN_TIME:
+		*value = clean_time[zone_cur];
+		break;
+	case PROTO_PARAM_TOPOFF:
+		*value = topOff_fill_delay[zone_cur];
+		break;
+	case PROTO_PARAM_NIGHT_MODE:
+		*value = night_mode;
+		break;
+	case PROTO_PARAM_MODE:
+		*value = zone_mode(zone_cur);
+		break;
+	case PROTO_PARAM_VALVES:
+		*value = valve_on_a | (valve_on_d << 8);
+		break;
+	default:
+		return PROTO_ERR_PARAM;
+	}
+	return PROTO_OK;
+}
+
+//checks a parameter write, the limits are the same as on the settings screens
+uint8_t proto_param_check(uint8_t param, uint16_t value) {
+	switch(param) {
+	case PROTO_PARAM_CLEAN_TIME:	//2 to 17 fills per clean, not already passed
+		if(value < 10800 || value > 64800 || value % 3600 || value <= cycle_time())
+			return PROTO_ERR_RANGE;
+		break;
+	case PROTO_PARAM_TOPOFF:
+		if(value < TOPOFF_MIN_MS || value > TOPOFF_MAX_MS)
+			return PROTO_ERR_RANGE;
+		break;
+	case PROTO_PARAM_NIGHT_MODE:
+		if(value > 1)
+			return PROTO_ERR_RANGE;
+		break;
+	case PROTO_PARAM_MODE:
+	case PROTO_PARAM_VALVES:
+		return PROTO_ERR_RANGE;		//read only
+	default:
+		return PROTO_ERR_PARAM;
+	}
+	return PROTO_OK;
+}
+
+//writes a parameter checked by proto_param_check
+void proto_param_set(uint8_t param, uint16_t value) {
+	switch(param) {
+	case PROTO_PARAM_CLEAN_TIME:
+		clean_time[zone_cur] = value;
+		sched_dirty |= 1 << zone_cur;
+		break;
+	case PROTO_PARAM_TOPOFF:
+		topOff_fill_delay[zone_cur] = value;
+		break;
+	case PROTO_PARAM_NIGHT_MODE:
+		night_mode = value;
+		break;
+	}
+}
+
+//the settings config.h keeps in EEPROM
+void config_current(config_t *config) {
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		config->clean_time[zone] = clean_time[zone];
+		config->topOff_fill_delay[zone] = topOff_fill_delay[zone];
+	}
+	config->night_mode = night_mode;
+}
+
+//takes restored settings, each one that fails the checks of a binary
+//request write keeps its default
+void config_apply(const config_t *config) {
+	for (zone_cur = 0; zone_cur < ZONES; zone_cur++) {
+		if(proto_param_check(PROTO_PARAM_CLEAN_TIME, config->clean_time[zone_cur]) == PROTO_OK)
+			proto_param_set(PROTO_PARAM_CLEAN_TIME, config->clean_time[zone_cur]);
+		if(proto_param_check(PROTO_PARAM_TOPOFF, config->topOff_fill_delay[zone_cur]) == PROTO_OK)
+			proto_param_set(PROTO_PARAM_TOPOFF, config->topOff_fill_delay[zone_cur]);
+	}
+	zone_cur = zone_sel;
+	if(proto_param_check(PROTO_PARAM_NIGHT_MODE, config->night_mode) == PROTO_OK)
+		proto_param_set(PROTO_PARAM_NIGHT_MODE, config->night_mode);
+}
+
+//transition actions, see the ACT_* list in fsm.h
+void act_none(void) {
+}
+
+void act_night_toggle(void) {
+	night_mode = !night_mode;
+	evlog_add(night_mode ? EVLOG_NIGHT_MODE_ON : EVLOG_NIGHT_MODE_OFF, fsm_cause, zone_mode(zone_cur));
+}
+
+void act_night_off(void) {
+	night_mode = 0;
+	evlog_add(EVLOG_NIGHT_MODE_OFF, fsm_cause, zone_mode(zone_cur));
+}
+
+void act_clean_more(void) {
+	if(clean_time[zone_cur] < 63000)	//cannot overflow, max 18 hour clean time
+		clean_time[zone_cur] += 3600;
+	sched_dirty |= 1 << zone_cur;
+}
+
+void act_clean_less(void) {
+	if(clean_time[zone_cur] > 10800)	//cannot go under 2 fills per clean
+		clean_time[zone_cur] -= 3600;
+	sched_dirty |= 1 << zone_cur;
+}
+
+void act_clean_home(void) {
+	if(cycle_time() > clean_time[zone_cur]) {
+		clean_time[zone_cur] = clean_time[zone_cur] + 3600;
+		sched_dirty |= 1 << zone_cur;
+	}
+}
+
+void act_fill_more(void) {
+	if(topOff_fill_delay[zone_cur] <= TOPOFF_MAX_MS - 1000)
+		topOff_fill_delay[zone_cur] += 1000;
+}
+
+void act_fill_less(void) {
+	if(topOff_fill_delay[zone_cur] >= TOPOFF_MIN_MS + 1000)
+		topOff_fill_delay[zone_cur] -= 1000;
+}
+
+void act_ext_fill(void) {
+	resetFill[zone_cur] = 1;	//the cycle restarts once the fill is over
+}
+
+void act_skip_to_fill(void) {
+	restart_cycle(3600);	//skip to fill event
+}
+
+void act_next_zone(void) {
+	zone_select((zone_sel + 1) % ZONES);
+}
+
+void home_entry(void) {
+	zone_release(zone_cur);	//close every valve of the zone
+	disabled[zone_cur] = 0;
+}
+
+//the diagnostics hold the SSRs no zone needs on, they let go of them
+//before any other state runs, and a zone still waiting in the queue opens
+void diag_exit(void) {
+	valve_test(0);
+	zone_next();
+}
+
+void disabled_entry(void) {
+	disabled[zone_cur] = 1;
+}
+
+//during a fill, fill valve and BB2 valve are open, TCB3 closes them when
+//the time is up. The valves open once the water supply is free, see zone.h
 void start_fill(void) {
-	mode = 'f';
-	PORTA.OUT |= 0b00000100; //open fill valve
-	PORTD.OUT |= 0b10000010; //open BB2 valve and enable ENAC-
-	if(clean == 1) { //fill duration is 45 sec if after clean event
-		delay_end = second_counter + fill_delay;
+	uint16_t ms;
+	if(clean[zone_cur] == 1) { //fill duration is 45 sec if after clean event
+		ms = fill_delay;
 	}else {	//fill duration defaults to 20 secs if top off fill
-		delay_end = second_counter + topOff_fill_delay;
+		ms = topOff_fill_delay[zone_cur];
+	}
+	zone_request(zone_cur, ZONE_FILL, ms, 0);
+}
+
+//closes the valves when a fill ends or is cancelled
+void stop_fill(void) {
+	zone_release(zone_cur);
+	if(resetFill[zone_cur] == 1) { //if external fill, restart the cycle
+		restart_cycle(0);
+		resetFill[zone_cur] = 0;
+	}
+	if(clean[zone_cur] == 1) { //if clean event was before filling, restart the cycle
+		restart_cycle(0);
+		clean[zone_cur] = 0;
 	}
 }
 
-//during clean, clean valve and BB2 valve are open, then BB2 closes after 15 secs
+//during clean, clean valve and BB2 valve are open, then BB2 closes after 15 secs,
+//both times are kept by TCB3
 void start_clean(void) {
-	clean = 1; //set clean to 1 so that the system knows that a clean event occurred
-	mode = 'c'; 
-	PORTA.OUT |= 0b00001000; //open clean valve
-	PORTD.OUT |= 0b10000010; //open BB2 valve and enable ENAC-
-	delay_end = second_counter + clean_delay;
-}
-
-//cancel_fill and cancel_clean are used to cancel clean/fill during the event by pressing any of the pushbuttons for the LCD
-void cancel_fill(void) {
-	PORTA.OUT &= 0b11111011;
-	PORTD.OUT &= 0b01111101;
-	mode = ((disabled == 1) ? 'd' : 'h'); //go back to disabled menu if previously disabled
-	if(resetFill == 1) { //if external fill, reset second_counter to 0
-		second_counter = 0;
-		resetFill = 0;
+	clean[zone_cur] = 1; //set clean to 1 so that the system knows that a clean event occurred
+	zone_request(zone_cur, ZONE_CLEAN, clean_delay, clean_bb2_delay);
+}
+
+//closes the valves when a clean ends or is cancelled, the fill after it
+//opens BB2 again
+void stop_clean(void) {
+	zone_release(zone_cur);
+}
+
+void (* const fsm_actions[FSM_ACTIONS])(void) = {
+	[ACT_NONE] = act_none,
+	[ACT_NIGHT_TOGGLE] = act_night_toggle,
+	[ACT_NIGHT_OFF] = act_night_off,
+	[ACT_CLEAN_MORE] = act_clean_more,
+	[ACT_CLEAN_LESS] = act_clean_less,
+	[ACT_CLEAN_HOME] = act_clean_home,
+	[ACT_FILL_MORE] = act_fill_more,
+	[ACT_FILL_LESS] = act_fill_less,
+	[ACT_EXT_FILL] = act_ext_fill,
+	[ACT_SKIP_TO_FILL] = act_skip_to_fill,
+	[ACT_HOME_ENTRY] = home_entry,
+	[ACT_DISABLED_ENTRY] = disabled_entry,
+	[ACT_FILL_ENTRY] = start_fill,
+	[ACT_FILL_EXIT] = stop_fill,
+	[ACT_CLEAN_ENTRY] = start_clean,
+	[ACT_CLEAN_EXIT] = stop_clean,
+	[ACT_NEXT_ZONE] = act_next_zone,
+	[ACT_DIAG_EXIT] = diag_exit,
+};
+
+//poll actions, see the POLL_* list in fsm.h
+uint8_t poll_none(void) {
+	return EV_NONE;
+}
+
+uint8_t poll_disabled(void) {
+	restart_cycle(0);	//schedule stays put while disabled
+	return EV_NONE;
+}
+
+//the valves are already closed when these see the time ran out
+uint8_t poll_filling(void) {
+	return zone_take_done(zone_cur) ? EV_TIMEOUT : EV_NONE;
+}
+
+uint8_t poll_cleaning(void) {
+	return zone_take_done(zone_cur) ? EV_TIMEOUT : EV_NONE;
+}
+
+uint8_t poll_diag(void) {
+	runDiagnostics();
+	return EV_NONE;
+}
+
+uint8_t poll_night(void) {
+	restart_cycle(0);
+	return night_dark ? EV_NONE : EV_LIGHT;
+}
+
+uint8_t (* const fsm_polls[FSM_POLLS])(void) = {
+	[POLL_NONE] = poll_none,
+	[POLL_DISABLED] = poll_disabled,
+	[POLL_FILLING] = poll_filling,
+	[POLL_CLEANING] = poll_cleaning,
+	[POLL_DIAG] = poll_diag,
+	[POLL_NIGHT] = poll_night,
+};
+
+//logs a change of state, the fill, clean, disable and night mode ones, runs
+//before the entry action of the new state
+void evlog_transition(uint8_t from, uint8_t to) {
+	char mode = zone_mode(zone_cur);
+	if(from == ST_FILLING)
+		evlog_add((fsm_cause == EVLOG_CAUSE_TIMER) ? EVLOG_FILL_DONE : EVLOG_FILL_CANCEL, fsm_cause, mode);
+	if(from == ST_CLEANING)
+		evlog_add((fsm_cause == EVLOG_CAUSE_TIMER) ? EVLOG_CLEAN_DONE : EVLOG_CLEAN_CANCEL, fsm_cause, mode);
+	if(from == ST_NIGHT)
+		evlog_add(EVLOG_NIGHT_END, fsm_cause, mode);
+	if(from == ST_DISABLED && to == ST_HOME)
+		evlog_add(EVLOG_ENABLE, fsm_cause, mode);
+	if(to == ST_FILLING)
+		evlog_add(EVLOG_FILL_START, fsm_cause, mode);
+	if(to == ST_CLEANING)
+		evlog_add(EVLOG_CLEAN_START, fsm_cause, mode);
+	if(to == ST_NIGHT)
+		evlog_add(EVLOG_NIGHT_START, fsm_cause, mode);
+	if(to == ST_DISABLED && disabled[zone_cur] == 0)	//not back from a fill or clean
+		evlog_add(EVLOG_DISABLE, fsm_cause, mode);
+}
+
+//***************************************************************************
+//
+// Function Name        : "fsm_dispatch"
+// Date                 : 10/17/26
+// Version              : 1.2
+// Target MCU           : AVR128DB48
+// Target Hardware      ; SSR valves
+// Author               : Vanessa Li
+// DESCRIPTION
+// Looks up the transition for the current state of zone_cur and event in
+// fsm_table and runs it. Leaving a state runs its exit action, then the transition
+// action, then the entry action of the new state. FSM_STAY only runs the
+// transition action. Changes of state are written to the event log with
+// the cause of the event.
+//
+// Warnings             : none
+// Restrictions         : event must be below FSM_EVENTS or EV_NONE
+// Algorithms           : table lookup
+// References           : fsm.h, evlog_transition()
+//
+// Revision History     : Initial version
+//						  v1.1 Event log
+//						  v1.2 A state per zone
+//
+//**************************************************************************
+void fsm_dispatch(uint8_t event) {
+	if(event == EV_NONE) {
+		return;
+	}
+	const fsm_transition_t *t = &fsm_table[fsm_state[zone_cur] - FSM_FIRST_STATE][event];
+	uint8_t next = pgm_read_byte(&t->next);
+	uint8_t action = pgm_read_byte(&t->action);
+	uint8_t prev = fsm_state[zone_cur];
+	fsm_cause = pgm_read_byte(&event_causes[event]);
+	if(next == FSM_STAY) {
+		fsm_actions[action]();
+		return;
+	}
+	if(next == FSM_BACK) {
+		next = (disabled[zone_cur] == 1) ? ST_DISABLED : ST_HOME; //go back to disabled menu if previously disabled
+	}
+	fsm_actions[pgm_read_byte(&fsm_states[prev - FSM_FIRST_STATE].exit)]();
+	fsm_actions[action]();
+	fsm_state[zone_cur] = next;
+	mode = zone_mode(zone_sel);
+	evlog_transition(prev, next);
+	fsm_actions[pgm_read_byte(&fsm_states[next - FSM_FIRST_STATE].entry)]();
+}
+
+//dispatches an event to the state machine of a zone
+void zone_dispatch(uint8_t zone, uint8_t event) {
+	zone_cur = zone;
+	fsm_dispatch(event);
+	zone_cur = zone_sel;
+}
+
+//***************************************************************************
+//
+// Function Name        : "update_mode"
+// Date                 : 10/17/26
+// Version              : 1.2
+// Target MCU           : AVR128DB48
+// Target Hardware      ; SSR valves
+// Author               : Vanessa Li
+// DESCRIPTION
+// Runs the poll action of the current state of every zone on every pass of
+// the main loop, like ending a fill or clean when its time is up, and
+// dispatches the event it returns.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : fsm_dispatch()
+//
+// Revision History     : Initial version
+//						  v1.1 Per state poll actions from fsm.h instead of
+//								a switch on mode
+//						  v1.2 Zones
+//
+//**************************************************************************
+void update_mode(void) {
+	uint8_t poll;
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		zone_cur = zone;
+		poll = pgm_read_byte(&fsm_states[fsm_state[zone] - FSM_FIRST_STATE].poll);
+		zone_dispatch(zone, fsm_polls[poll]());
 	}
-	if(clean == 1) { //if clean event was before filling, reset second_counter to 0
-		second_counter = 0;
-		clean = 0;
+}
+
+//***************************************************************************
+//
+// Function Name        : "render_field"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy & Vanessa Li
+// DESCRIPTION
+// Writes one variable field of a screen template into the line buffer at
+// dst. The fields and their widths are listed in screens.h. They show
+// zone_sel.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : screen_render()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void render_field(uint8_t field, char *dst) {
+	int32_t left;
+	switch(field){
+		case FIELD_NIGHT_MODE:
+			memcpy_P(dst, (night_mode == 1) ? PSTR(" ON") : PSTR("OFF"), 3);
+			break;
+		case FIELD_LAST_KIND:
+			memcpy_P(dst, (cycle_time() < 3600) ? PSTR("CLN ") : PSTR("FILL"), 4);
+			break;
+		case FIELD_NEXT_KIND:
+		case FIELD_AFTER_KIND:
+			memcpy_P(dst, (sched_queue[zone_sel][field - FIELD_NEXT_KIND].kind == SCHED_CLEAN) ? PSTR("CLN ") : PSTR("FILL"), 4);
+			break;
+		case FIELD_SINCE:
+			screen_put_time(dst, (cycle_time()%3600)/60);
+			break;
+		case FIELD_NEXT_IN:
+		case FIELD_AFTER_IN:
+			screen_put_time(dst, (sched_queue[zone_sel][field - FIELD_NEXT_IN].at - clock_now())/60);
+			break;
+		case FIELD_FILLS:
+			screen_put_dec(dst, 2, clean_time[zone_sel]/3600 - 1, ' ');
+			break;
+		case FIELD_FILL_MIN:
+			screen_put_dec(dst, 1, topOff_fill_delay[zone_sel]/60000, ' ');
+			break;
+		case FIELD_FILL_SEC:
+			screen_put_dec(dst, 2, (topOff_fill_delay[zone_sel]/1000)%60, ' ');
+			break;
+		case FIELD_REMAINING:
+			left = zone_delay_end[zone_sel] - clock_now();
+			screen_put_time(dst, (left > 0) ? left : 0);
+			break;
+		case FIELD_IP:
+			for (uint8_t i = 0; i < SCREEN_COLS && IPAdd[i] != '\0'; i++) {
+				dst[i] = IPAdd[i];
+			}
+			break;
+		case FIELD_AIN1:
+			screen_put_mv(dst, AIN1);
+			break;
+		case FIELD_AIN2:
+			screen_put_mv(dst, AIN2);
+			break;
+		case FIELD_AIN3:
+			screen_put_mv(dst, AIN3);
+			break;
+		case FIELD_NIGHT_PROMPT:
+			memcpy_P(dst, (night_mode == 1) ? screen_prompt_nm_off : screen_prompt_nm_on, SCREEN_COLS);
+			break;
+		case FIELD_POST_FILL:
+		case FIELD_POST_BB2:
+		case FIELD_POST_CLEAN:
+		case FIELD_POST_SOLAR:
+			memcpy_P(dst, (post_result & (1 << (field - FIELD_POST_FILL))) ? PSTR("GOOD") : PSTR("FAIL"), 4);
+			break;
+#if ZONES > 1
+		case FIELD_ZONE:
+			dst[0] = 'Z';
+			dst[1] = '1' + zone_sel;
+			break;
+		case FIELD_ZONE_KEY:
+			memcpy_P(dst, PSTR("ZONE"), 4);
+			break;
+#endif
 	}
 }
 
-void cancel_clean(void) {
-	PORTA.OUT &= 0b11110111;
-	PORTD.OUT &= 0b01111101;
-	second_counter = 3600;	//skip to fill event
+//***************************************************************************
+//
+// Function Name        : "render_screen"
+// Date                 : 10/17/26
+// Version              : 1.2
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy & Vanessa Li
+// DESCRIPTION
+// Fills the four LCD line buffers with the screen for the current mode, or
+// with the POST results while boot_task() shows them. Only called when the
+// display is dirty, see the main loop.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : update_mode(), screen_render()
+//
+// Revision History     : Initial version
+//						  v1.1 Screens come from the flash templates in
+//								screens.h instead of snprintf
+//						  v1.2 POST screen
+//
+//**************************************************************************
+void render_screen(void) {
+	screen_render((boot_stage == BOOT_SHOW) ? 'p' : mode);
 }
 
 int main(void) {
-	init_lcd_dog();
+	uint8_t due;
+	char shown_mode = 0;			//mode the LCD was last drawn for
+	uint8_t shown_scan = 0;			//ADC scan the diagnostics screen was last drawn for
+	uint8_t last_frame = 0;			//ui_ticks when the LCD was last drawn
+	config_t config;
+	
+	clock_init();		//first, boot_ready_ticks counts from here
+	//restore the settings and the event log before anything runs on them
+	config_current(&config);
+	if(config_load(&config)) {
+		config_apply(&config);
+	}
+	evlog_init();
+	init_lcd_dog();		//queued, runs while the main loop does
 	port_init();
-	TCA0_init();
+	debounce_init();
+	prof_init();
 	USART0_init();
 	ADC0_init();
+	post_start();		//the rest of the boot is done by boot_task()
+	zone_publish();
 	sei();
 	while(1) {
-		//check if time for a fill or clean cycle
-		if(second_counter%3600 == 0 && second_counter != clean_time && second_counter >= 3600){
-			start_fill();
-		}else if(second_counter == clean_time){
-			start_clean();
+		if(boot_task(mode)) {
+			USART0_rx_task();
+			button_task();
 		}
+		telemetry_task();
 		
-		//check if time to enter night mode
- 		if(solarConversion() < 1.6 && night_mode == 1) {
- 			mode = 'g';
- 		}
+		//start the fill or clean cycle of the zones the tick flagged
+		if(sched_dirty) {
+			for (uint8_t zone = 0; zone < ZONES; zone++) {
+				if(sched_dirty & (1 << zone))
+					sched_rebuild(zone, clock_now(), cycle_start[zone], clean_time[zone]);
+			}
+			sched_dirty = 0;
+			sched_publish();
+		}
+		due = sched_take_due();
+		if(due & SCHED_EVENT) {
+			for (uint8_t zone = 0; zone < ZONES; zone++) {
+				if((int32_t)(clock_now() - sched_queue[zone][0].at) < 0)
+					continue;
+				zone_dispatch(zone, (sched_queue[zone][0].kind == SCHED_CLEAN) ? EV_SCHED_CLEAN : EV_SCHED_FILL);
+				sched_advance(zone, cycle_start[zone], clean_time[zone]);
+			}
+			sched_publish();
+		}
 		
-		switch(mode){
-			case 'd': //disabled menu
-				snprintf(dsp_buff1, 21, "                     ");
-				snprintf(dsp_buff2, 21, "   SYSTEM DISABLED   ");
-				snprintf(dsp_buff3, 21, "                     ");
-				snprintf(dsp_buff4, 21, "                ENBL ");
-				second_counter = 0;
-				disabled = 1;
-			break;
-			case 'h'://home menu
-				PORTA.OUT &= 0b11111011;
-				PORTD.OUT &= 0b01111111;
-				PORTA.OUT &= 0b11110111;
-				disabled = 0;
-				snprintf(dsp_buff1, 21, "LAST NEXT NEXT    NM");
-				if(second_counter < 3600){
-					snprintf(dsp_buff2, 21, "CLN  FILL FILL   %s ", (night_mode == 1) ? " ON" : "OFF");
-					snprintf(dsp_buff3, 21, "%d:%02d 0:%02d 1:%02d      ", 
-					(second_counter)/3600, (second_counter%3600)/60,
-					(3600 - (second_counter%3600))/60,
-					(3600 - (second_counter%3600))/60);
-				}else if(abs(clean_time - second_counter) < 3600) {
-					snprintf(dsp_buff2, 21, "FILL CLN  FILL   %s ", (night_mode == 1) ? " ON" : "OFF");
-					snprintf(dsp_buff3, 21, "%d:%02d 0:%02d 1:%02d      ",
-					(second_counter%3601)/3600, (second_counter%3600)/60,
-					(3600 - (second_counter%3600))/60,
-					(3600 - (second_counter%3600))/60);
-				}else if(clean_time - second_counter < (3600*2) && clean_time - second_counter > 3600) {
-					snprintf(dsp_buff2, 21, "FILL FILL CLN    %s ", (night_mode == 1) ? " ON" : "OFF");
-					snprintf(dsp_buff3, 21, "%d:%02d 0:%02d 1:%02d      ",
-					(second_counter%3601)/3600, (second_counter%3600)/60,
-					(3600 - (second_counter%3600))/60,
-					(3600 - (second_counter%3600))/60);
-				}else if(clean_time - second_counter > (3600*2)) {
-					snprintf(dsp_buff2, 21, "FILL FILL FILL   %s ", (night_mode == 1) ? " ON" : "OFF");
-					snprintf(dsp_buff3, 21, "%d:%02d 0:%02d 1:%02d      ",
-					(second_counter%3601)/3600, (second_counter%3600)/60,
-					(3600 - (second_counter%3600))/60,
-					(3600 - (second_counter%3600))/60);
+		//feed the night detector once a second and check if time to enter
+		//night mode
+		if((due & SCHED_NIGHT) && adc_scan_count) {
+			night_update(solarConversion(), clock_now());
+			if(night_dark && night_mode == 1) {
+				for (uint8_t zone = 0; zone < ZONES; zone++) {
+					zone_dispatch(zone, EV_DARK);
 				}
-				snprintf(dsp_buff4, 21, "MODE DIAG CLEAN FILL");
-				break;
-			case 'l'://schedule clean menu
-				snprintf(dsp_buff1, 21, "Fill Every Hour     ");
-				snprintf(dsp_buff2, 21, "How many Fills?      ");
-				snprintf(dsp_buff3, 21, "%d Fills per 1 Clean ", clean_time/3600 - 1);
-				snprintf(dsp_buff4, 21, "INC  DEC  CLEAN HOME ");
-				break;
-			case 'i'://schedule fill menu 
-				snprintf(dsp_buff1, 21, "Duration of fill?    ");
-				snprintf(dsp_buff2, 21, "%dm %ds              ", topOff_fill_delay/60, topOff_fill_delay%60);
-				snprintf(dsp_buff3, 21, "                     ");
-				snprintf(dsp_buff4, 21, "INC  DEC  HOME  FILL ");
-				break;
-			case 'e'://disable system menu
-				snprintf(dsp_buff1, 21, "DISABLE SYSTEM?     ");
-				snprintf(dsp_buff2, 21, "                    ");
-				snprintf(dsp_buff3, 21, "                    ");
-				snprintf(dsp_buff4, 21, "YES    NO           ");
-				break;
-			case 'n'://enable night mode menu
-				if(night_mode == 1) {
-					snprintf(dsp_buff1, 21, "Turn off night mode? ");
-				}else if(night_mode == 0){
-					snprintf(dsp_buff1, 21, "Turn on night mode?  ");
-				}
-				snprintf(dsp_buff2, 21, "                    ");
-				snprintf(dsp_buff3, 21, "                    ");
-				snprintf(dsp_buff4, 21, "YES    NO           ");
-				break;
-			case 'f'://fill menu
-				snprintf(dsp_buff1, 21, "Currently Filling    ");
-				snprintf(dsp_buff2, 21, "Time Remaining: %d:%02d ", 
-				(delay_end - second_counter)/ 60, (delay_end - second_counter) %60);
-				snprintf(dsp_buff3, 21, "                     ");
-				snprintf(dsp_buff4, 21, "Any Button to Cancel ");
-				if(second_counter >= delay_end) { //end fill
-					PORTA.OUT &= 0b11111011; //close fill valve
-					PORTD.OUT &= 0b01111101; //close BB2 valve and disable ENAC-
-					mode = ((disabled == 1) ? 'd' : 'h'); //go back to disabled menu if previously disabled
-					if(resetFill == 1) { //if external fill, reset second_counter to 0
-						second_counter = 0;
-						resetFill = 0;
-					}
-					if(clean == 1) { //if clean event was before filling, reset second_counter to 0
-						second_counter = 0;
-						clean = 0;
-					}
-				}
-				break;
-			case 'c'://clean menu 
-				snprintf(dsp_buff1, 21, "Currently Cleaning   ");
-				snprintf(dsp_buff2, 21, "Time Remaining: %d:%02d ", (delay_end - second_counter)/ 60, (delay_end - second_counter) %60);
-				snprintf(dsp_buff3, 21, "                      ");
-				snprintf(dsp_buff4, 21, "Any Button to Cancel  ");
-				if (delay_end - second_counter <= 30){ 
-					PORTD.OUT &= 0b01111111; //close BB2 after 15 seconds
-				}
-				if(second_counter >= delay_end) { 
-					PORTA.OUT &= 0b11110111; //turn off clean valve
-					PORTD.OUT &= 0b11111101; //disable ENAC-
-					second_counter = 3600;	//skip to fill event
-					start_fill();
-				}
-				break;
-			case 'm'://mode menu
-				snprintf(dsp_buff1, 21, "Select an option:   ");
-				snprintf(dsp_buff2, 21, "                    ");
-				snprintf(dsp_buff3, 21, "%s                    ", IPAdd);  //Print IP address
-				snprintf(dsp_buff4, 21, "DSBL  NM        HOME");
-				break;
-			case 'a'://diagnostics menu
-				{
-					runDiagnostics();
-					int tempInt1 = AIN1;
-					double tempFrac1 = AIN1 - tempInt1;
-					int fracInt1 = trunc(tempFrac1 * 100);
-					int tempInt2 = AIN2;
-					double tempFrac2 = AIN2 - tempInt2;
-					int fracInt2 = trunc(tempFrac2 * 100);
-					int tempInt3 = AIN3;
-					double tempFrac3 = AIN3 - tempInt3;
-					int fracInt3 = trunc(tempFrac3 * 100);
-					snprintf(dsp_buff1, 21, "SSR1 SSR2  SSR3  SOL");
-					snprintf(dsp_buff2, 21, "%d.%02d %d.%02d  %d.%02d      ",
-					tempInt1, fracInt1, tempInt2, fracInt2, tempInt3, fracInt3);
-					snprintf(dsp_buff3, 21, "                    ");
-					snprintf(dsp_buff4, 21, "                HOME");
-				}
-				break;
-			case 'g': //night mode menu
-				snprintf(dsp_buff1, 21, "                     ");
-				snprintf(dsp_buff2, 21, "     NIGHT MODE      ");
-				snprintf(dsp_buff3, 21, "                     ");
-				snprintf(dsp_buff4, 21, "                DSBL ");
-				second_counter = 0;
-				PORTF.PIN0CTRL = 0b00001100; //disable interrupt for external pushbuttons
-				PORTF.PIN1CTRL = 0b00001100; 
-	 			if(solarConversion() >= 1.6) { 
-	 				mode = 'h';
-	 			}
-				break;
+			}
+		}
+		
+		zone_task();
+		update_mode();
+		zone_publish();
+		
+		config_current(&config);
+		config_task(&config, clock_now());
+		evlog_task();
+		
+		//redraw only when something on screen changed, at most once per frame
+		if(mode != shown_mode) {
+			lcd_dirty = 1;
+		}
+		if(mode == 'a' && adc_scan_count != shown_scan) {
+			lcd_dirty = 1;
+		}
+		if(lcd_dirty && boot_stage != BOOT_POST && (uint8_t)(ui_ticks - last_frame) >= LCD_FRAME_TICKS) {
+			lcd_dirty = 0;
+			last_frame = ui_ticks;
+			shown_mode = mode;
+			shown_scan = adc_scan_count;
+			{
+				PROF_BEGIN(PROF_RENDER);
+				render_screen();
+				PROF_END(PROF_RENDER);
+			}
+			{
+				PROF_BEGIN(PROF_LCD_UPDATE);
+				if(!update_lcd_dog())
+					lcd_dirty = 1;	//the rest of the frame goes out next time
+				PROF_END(PROF_LCD_UPDATE);
+			}
+			lcd_frames_rendered++;
+		}else {
+			lcd_frames_skipped++;
 		}
-		update_lcd_dog();
+		hal_idle();
 	}
 }
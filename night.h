@@ -0,0 +1,79 @@
+/*
+ * night.h
+ *
+ * Created: 10/17/2026 10:48:20 PM
+ *  Author: Vanessa
+ */
+
+
+#ifndef NIGHT_H_
+#define NIGHT_H_
+
+//Night detector. Once a second the main loop feeds it the latest background
+//reading of the solar panel, which goes through an exponential moving
+//average. It turns dark once the average drops below NIGHT_ENTER_MV and
+//light again once it rises above NIGHT_EXIT_MV, and after a change it
+//holds for at least NIGHT_DWELL_S seconds, so noise at dusk and dawn does
+//not flip it back and forth. An update is one shift, one add and two
+//compares.
+#define NIGHT_ENTER_MV 1600			//filtered solar panel below this means night
+#define NIGHT_EXIT_MV 1900			//filtered solar panel above this means day
+#define NIGHT_EMA_SHIFT 4			//new sample weighs 1/16, time constant of 16 s
+#define NIGHT_DWELL_S 600			//shortest time between two changes
+
+uint16_t night_sum = 0;				//average times 2^NIGHT_EMA_SHIFT
+uint8_t night_dark = 0;				//1 while it is night
+uint8_t night_primed = 0;			//1 once the first sample is in
+uint32_t night_changed_at = 0;		//clock_seconds of the last change
+
+uint8_t night_update(uint16_t mv, uint32_t now);
+
+#endif /* NIGHT_H_ */
+
+//returns the filtered solar panel voltage in millivolts
+static inline uint16_t night_filtered_mv(void) {
+	return night_sum >> NIGHT_EMA_SHIFT;
+}
+
+//***************************************************************************
+//
+// Function Name        : "night_update"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; none
+// Author               : Vanessa Li
+// DESCRIPTION
+// Folds a solar panel reading mv taken at clock_seconds now into the
+// average and decides whether it is night. Returns 1 if night_dark
+// changed. The first reading fills the average and sets night_dark
+// directly.
+//
+// Warnings             : none
+// Restrictions         : mv must be below 4096
+// Algorithms           : Exponential moving average, sum += mv - sum / 2^k,
+//						  with hysteresis and a minimum dwell time
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+uint8_t night_update(uint16_t mv, uint32_t now){
+	uint16_t filtered;
+	if(!night_primed) {
+		night_primed = 1;
+		night_sum = mv << NIGHT_EMA_SHIFT;
+		night_dark = mv < NIGHT_ENTER_MV;
+		night_changed_at = now;
+		return 1;
+	}
+	night_sum = night_sum + mv - (night_sum >> NIGHT_EMA_SHIFT);
+	if(now - night_changed_at < NIGHT_DWELL_S)
+		return 0;
+	filtered = night_filtered_mv();
+	if(night_dark ? filtered <= NIGHT_EXIT_MV : filtered >= NIGHT_ENTER_MV)
+		return 0;
+	night_dark = !night_dark;
+	night_changed_at = now;
+	return 1;
+}
@@ -0,0 +1,132 @@
+/*
+ * profile.h
+ *
+ * Created: 10/17/2026 6:02:45 PM
+ *  Author: Brandon
+ */
+
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+//Section profiler. PROF_BEGIN/PROF_END around a block time it in CPU cycles
+//off TCB2, which free-runs at F_CPU with no interrupt. Each section keeps
+//count, min, max and a running total for the mean, "prof" over USART prints
+//them. Build with PROFILE=1 to compile it in, otherwise the macros are
+//empty and TCB2 stays off.
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+//sections, add a name to prof_names when adding one
+#define PROF_LCD_UPDATE 0		//update_lcd_dog()
+#define PROF_RENDER 1			//render_screen()
+#define PROF_TICK 2				//RTC one second tick ISR
+#define PROF_DEBOUNCE 3			//TCB1 button ISR
+#define PROF_SECTIONS 4
+
+typedef struct {
+	uint32_t count;
+	uint32_t total;			//sum of all times, halved together with count
+	uint16_t min;
+	uint16_t max;
+} prof_stat_t;
+
+#if PROFILE
+prof_stat_t prof_stats[PROF_SECTIONS];
+const char *const prof_names[PROF_SECTIONS] = {"lcd", "render", "tick", "debounce"};
+
+//the start count lives in a local, so a section opens and closes in the
+//same block
+#define PROF_BEGIN(id) uint16_t prof_start_##id = TCB2.CNT
+#define PROF_END(id) prof_record(&prof_stats[id], TCB2.CNT - prof_start_##id)
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+void prof_init(void);
+void prof_reset(void);
+void prof_dump(void);
+
+#endif /* PROFILE_H_ */
+
+#if PROFILE
+//folds one measurement into a section, inline so a profiled ISR does not
+//have to save the registers a call would clobber
+static inline void prof_record(prof_stat_t *stat, uint16_t cycles) {
+	if(cycles < stat->min)
+		stat->min = cycles;
+	if(cycles > stat->max)
+		stat->max = cycles;
+	stat->count++;
+	stat->total += cycles;
+	if(stat->total & 0x80000000UL) {	//keep the mean, drop old history
+		stat->total >>= 1;
+		stat->count >>= 1;
+	}
+}
+#endif
+
+//***************************************************************************
+//
+// Function Name        : "prof_init"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; TCB2
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Starts TCB2 counting CPU cycles from 0 to 0xFFFF and over again, the
+// profiler reads CNT at the start and end of a section.
+//
+// Warnings             : Sections longer than 65535 cycles (16 ms) wrap.
+//						  An ISR that reads CNT between the two byte reads
+//						  of a main loop section shows up as a bogus max
+// Restrictions         : none
+// Algorithms           : none
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void prof_init(void) {
+#if PROFILE
+	prof_reset();
+	TCB2.CCMP = 0xFFFF;
+	TCB2.CTRLB = TCB_CNTMODE_INT_gc;	//periodic mode, interrupt left off
+	TCB2.CTRLA = TCB_CLKSEL_DIV1_gc | TCB_ENABLE_bm;
+#endif
+}
+
+//clears the statistics of every section
+void prof_reset(void) {
+#if PROFILE
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for (uint8_t i = 0; i < PROF_SECTIONS; i++) {
+			prof_stats[i].count = 0;
+			prof_stats[i].total = 0;
+			prof_stats[i].min = 0xFFFF;
+			prof_stats[i].max = 0;
+		}
+	}
+#endif
+}
+
+//prints the statistics of every section in CPU cycles
+void prof_dump(void) {
+#if PROFILE
+	prof_stat_t stat;
+	printf("section      count   min   max  mean\n");
+	for (uint8_t i = 0; i < PROF_SECTIONS; i++) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			stat = prof_stats[i];
+		}
+		printf("%-8s %9lu %5u %5u %5lu\n", prof_names[i], (unsigned long)stat.count,
+			stat.count ? stat.min : 0, stat.max,
+			stat.count ? (unsigned long)(stat.total / stat.count) : 0UL);
+	}
+#else
+	printf("profiler not built in, build with PROFILE=1\n");
+#endif
+}
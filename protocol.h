@@ -0,0 +1,241 @@
+/*
+ * protocol.h
+ *
+ * Created: 10/17/2026 8:40:12 PM
+ *  Author: Brandon
+ */
+
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+//Binary requests from the host, next to the text commands. A request is
+//framed like a telemetry frame, COBS encoded with a CRC-16/XMODEM, but it
+//also starts with a 0x00 so USART0_rx_task can tell it from a text line:
+//	0x00, COBS(type, id, ops..., CRC low, CRC high), 0x00
+//Frames sent back to back may share the 0x00 between them. A text line
+//after a frame starts with its command, never with a byte below
+//USART_LINE_SIZE, which would be taken for the start of another frame.
+//	byte 0		PROTO_FRAME_REQUEST
+//	byte 1		request id, chosen by the host and sent back in the reply
+//	byte 2-		one or more operations, run in order:
+//		PROTO_OP_FILL, PROTO_OP_CLEAN, PROTO_OP_DISABLE, PROTO_OP_CANCEL
+//				same as the text commands
+//		PROTO_OP_LOG					starts an event log dump, see eventlog.h
+//		PROTO_OP_READ, param			reads a parameter
+//		PROTO_OP_WRITE, param, lo, hi	writes a parameter
+//		PROTO_OP_ZONE, zone				the operations after it go to zone,
+//										from 0, see zone.h
+//Operations go to the zone on the LCD until a PROTO_OP_ZONE.
+//Every request gets one reply frame, sent like telemetry:
+//	byte 0		PROTO_FRAME_REPLY
+//	byte 1		request id
+//	byte 2		PROTO_OK or the PROTO_ERR_* of the first bad operation
+//	byte 3		offset of the first bad operation in the request, 0 if OK
+//	byte 4-		param, lo, hi for every PROTO_OP_READ, in request order
+//All operations are checked before any of them runs, so a request with a
+//bad operation changes nothing. The host may send the next requests
+//without waiting for a reply, they are answered in the order received.
+//Frames with a bad CRC are dropped without a reply and counted, the
+//"link" command prints the count.
+#define PROTO_FRAME_REQUEST 0x02
+#define PROTO_FRAME_REPLY 0x03
+#define PROTO_REPLY_HEAD 4			//reply bytes before the read values
+
+//operations
+#define PROTO_OP_FILL 0x01
+#define PROTO_OP_CLEAN 0x02
+#define PROTO_OP_DISABLE 0x03
+#define PROTO_OP_CANCEL 0x04
+#define PROTO_OP_LOG 0x05
+#define PROTO_OP_ZONE 0x06
+#define PROTO_OP_READ 0x10
+#define PROTO_OP_WRITE 0x11
+
+//parameters
+#define PROTO_PARAM_CLEAN_TIME 0x01		//seconds into the cycle of the clean, whole hours
+#define PROTO_PARAM_TOPOFF 0x02			//top off fill duration in milliseconds
+#define PROTO_PARAM_NIGHT_MODE 0x03		//1 on, 0 off, the same for every zone
+#define PROTO_PARAM_MODE 0x04			//screen letter of the state, read only
+#define PROTO_PARAM_VALVES 0x05			//valve pins that are on, PORTA low byte and
+										//PORTD high byte, read only, see valve.h
+
+//reply status
+#define PROTO_OK 0
+#define PROTO_ERR_OP 1				//unknown operation
+#define PROTO_ERR_PARAM 2			//unknown parameter
+#define PROTO_ERR_RANGE 3			//value out of range, parameter read only or no such zone
+#define PROTO_ERR_LENGTH 4			//operation cut short, or too many reads to reply
+
+uint16_t proto_bad_frames = 0;		//number of frames dropped for a bad CRC or encoding
+
+void proto_receive(uint8_t *frame, uint8_t len);
+
+//parameter access, in main.c, of zone_cur
+uint8_t proto_param_get(uint8_t param, uint16_t *value);
+uint8_t proto_param_check(uint8_t param, uint16_t value);
+void proto_param_set(uint8_t param, uint16_t value);
+void fsm_dispatch(uint8_t event);
+
+#endif /* PROTOCOL_H_ */
+
+//events of the command operations, PROTO_OP_FILL to PROTO_OP_CANCEL
+const uint8_t proto_events[4] PROGMEM = {
+	EV_CMD_FILL, EV_CMD_CLEAN, EV_CMD_DISABLE, EV_CMD_CANCEL,
+};
+
+//***************************************************************************
+//
+// Function Name        : "proto_check"
+// Date                 : 10/17/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; none
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Checks the operations of a decoded request of len bytes, without the CRC,
+// without running them. Returns PROTO_OK or the error of the first bad
+// operation, whose offset in the request is stored in *bad.
+//
+// Warnings             : Leaves zone_cur at the last zone selected
+// Restrictions         : none
+// Algorithms           : none
+// References           : proto_param_get(), proto_param_check()
+//
+// Revision History     : Initial version
+//						  v1.1 PROTO_OP_ZONE
+//
+//**************************************************************************
+uint8_t proto_check(const uint8_t *ops, uint8_t len, uint8_t *bad){
+	uint8_t i = 2;	//operations start after the type and id
+	uint8_t reply_len = PROTO_REPLY_HEAD;
+	uint8_t status;
+	uint16_t value;
+	while(i < len) {
+		*bad = i;
+		switch(ops[i]) {
+		case PROTO_OP_FILL:
+		case PROTO_OP_CLEAN:
+		case PROTO_OP_DISABLE:
+		case PROTO_OP_CANCEL:
+		case PROTO_OP_LOG:
+			i += 1;
+			break;
+		case PROTO_OP_READ:
+			if(i + 2 > len)
+				return PROTO_ERR_LENGTH;
+			reply_len += 3;
+			if(reply_len > TELEMETRY_MAX_FRAME - 2)
+				return PROTO_ERR_LENGTH;
+			status = proto_param_get(ops[i + 1], &value);
+			if(status != PROTO_OK)
+				return status;
+			i += 2;
+			break;
+		case PROTO_OP_WRITE:
+			if(i + 4 > len)
+				return PROTO_ERR_LENGTH;
+			status = proto_param_check(ops[i + 1], ops[i + 2] | (ops[i + 3] << 8));
+			if(status != PROTO_OK)
+				return status;
+			i += 4;
+			break;
+		case PROTO_OP_ZONE:
+			if(i + 2 > len)
+				return PROTO_ERR_LENGTH;
+			if(ops[i + 1] >= ZONES)
+				return PROTO_ERR_RANGE;
+			zone_cur = ops[i + 1];	//the checks after it are for that zone
+			i += 2;
+			break;
+		default:
+			return PROTO_ERR_OP;
+		}
+	}
+	*bad = 0;
+	return PROTO_OK;
+}
+
+//***************************************************************************
+//
+// Function Name        : "proto_receive"
+// Date                 : 10/17/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; USART0 output
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Called by USART0_rx_task with a received frame, still COBS encoded and
+// without its delimiters. Checks the CRC and the operations, runs them in
+// order and sends the reply frame.
+//
+// Warnings             : The frame is decoded in place
+// Restrictions         : Must not be called from an interrupt, it runs FSM
+//						  actions and prints
+// Algorithms           : none
+// References           : proto_check(), cobs_decode(), telemetry_send_frame()
+//
+// Revision History     : Initial version
+//						  v1.1 PROTO_OP_ZONE
+//
+//**************************************************************************
+void proto_receive(uint8_t *frame, uint8_t len){
+	uint8_t reply[TELEMETRY_MAX_FRAME - 2];
+	uint8_t reply_len = PROTO_REPLY_HEAD;
+	uint16_t crc = 0;
+	uint16_t value = 0;
+	uint8_t i;
+
+	len = cobs_decode(frame, len);
+	if(len < 4 || frame[0] != PROTO_FRAME_REQUEST) {
+		proto_bad_frames++;
+		return;
+	}
+	len -= 2;	//CRC
+	for (i = 0; i < len; i++) {
+		crc = _crc_xmodem_update(crc, frame[i]);
+	}
+	if(crc != (frame[len] | (frame[len + 1] << 8))) {
+		proto_bad_frames++;
+		return;
+	}
+
+	reply[0] = PROTO_FRAME_REPLY;
+	reply[1] = frame[1];
+	zone_cur = zone_sel;
+	reply[2] = proto_check(frame, len, &reply[3]);
+	zone_cur = zone_sel;
+	if(reply[2] == PROTO_OK) {
+		lcd_dirty = 1;
+		i = 2;
+		while(i < len) {
+			switch(frame[i]) {
+			case PROTO_OP_READ:
+				proto_param_get(frame[i + 1], &value);
+				reply[reply_len++] = frame[i + 1];
+				reply[reply_len++] = value & 0xFF;
+				reply[reply_len++] = value >> 8;
+				i += 2;
+				break;
+			case PROTO_OP_WRITE:
+				proto_param_set(frame[i + 1], frame[i + 2] | (frame[i + 3] << 8));
+				i += 4;
+				break;
+			case PROTO_OP_LOG:
+				evlog_dump();	//the chunks follow the reply
+				i += 1;
+				break;
+			case PROTO_OP_ZONE:
+				zone_cur = frame[i + 1];
+				i += 2;
+				break;
+			default:	//PROTO_OP_FILL to PROTO_OP_CANCEL
+				fsm_dispatch(pgm_read_byte(&proto_events[frame[i] - PROTO_OP_FILL]));
+				i += 1;
+				break;
+			}
+		}
+		zone_cur = zone_sel;
+	}
+	telemetry_send_frame(reply, reply_len);
+}
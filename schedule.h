@@ -0,0 +1,147 @@
+/*
+ * schedule.h
+ *
+ * Created: 10/17/2026 11:20:05 AM
+ *  Author: Vanessa
+ */ 
+
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+//Upcoming fill and clean events, kept sorted so sched_queue[0] is the next
+//event and sched_queue[1] the one after. Events are deadlines on the
+//clock_seconds timebase. A cycle starts at start, a fill happens every full
+//hour into the cycle and the clean clean_at seconds in, which replaces the
+//fill when both fall on the same second. Every zone has its own queue, see
+//zone.h. A queue only has to be rebuilt when its cycle is restarted or
+//its clean_time changes. sched_publish() hands the earliest deadline of all
+//zones to the tick ISR, which just compares the time against it, so the
+//tick costs the same however many zones there are. The main loop then
+//looks for the zones that came due.
+#define SCHED_FILL 0x01
+#define SCHED_CLEAN 0x02
+#define SCHED_NIGHT 0x04		//time to check whether night has fallen
+#define SCHED_EVENT 0x08		//the event of some zone came due
+#define SCHED_QUEUE_LEN 2
+
+typedef struct {
+	uint32_t at;		//clock_seconds when the event fires
+	uint8_t kind;		//SCHED_FILL or SCHED_CLEAN
+} sched_event_t;
+
+typedef struct {
+	uint32_t at;		//earliest sched_queue[zone][0]
+	uint8_t armed;		//0 once it fired, or while nothing was published
+} sched_next_t;
+
+sched_event_t sched_queue[ZONES][SCHED_QUEUE_LEN];
+volatile sched_next_t sched_next[2];	//deadline for the tick ISR, double
+										//buffered, see seqlock.h
+volatile uint8_t sched_next_cur = 0;	//the copy the tick ISR reads
+volatile uint8_t sched_due = 0;		//SCHED_NIGHT and SCHED_EVENT, taken by the main loop
+uint8_t sched_dirty = (1 << ZONES) - 1;	//bit per zone whose queue has to be rebuilt
+
+sched_event_t sched_after(uint32_t time, uint32_t start, uint16_t clean_at);
+void sched_rebuild(uint8_t zone, uint32_t now, uint32_t start, uint16_t clean_at);
+void sched_advance(uint8_t zone, uint32_t start, uint16_t clean_at);
+void sched_publish(void);
+void sched_tick(uint32_t now);
+uint8_t sched_take_due(void);
+
+#endif /* SCHEDULE_H_ */
+
+//returns the first event after time in the cycle that started at start
+sched_event_t sched_after(uint32_t time, uint32_t start, uint16_t clean_at){
+	sched_event_t event;
+	uint32_t into = time - start;
+	uint32_t hour = (into / 3600 + 1) * 3600;	//next full hour of the cycle
+	if(into < clean_at && clean_at <= hour) {
+		event.at = start + clean_at;
+		event.kind = SCHED_CLEAN;
+	}else {
+		event.at = start + hour;
+		event.kind = SCHED_FILL;
+	}
+	return event;
+}
+
+//hands the earliest event of all zones to the tick ISR, called after the
+//queues changed. The deadline is armed in the copy before the flip, so the
+//first tick after the flip already checks it. A tick before the flip may
+//flag SCHED_EVENT for the old deadline, the main loop finds nothing due then.
+void sched_publish(void){
+	uint32_t next = sched_queue[0][0].at;
+	for (uint8_t zone = 1; zone < ZONES; zone++) {
+		if((int32_t)(sched_queue[zone][0].at - next) < 0)
+			next = sched_queue[zone][0].at;
+	}
+	HAL_COPY(sched_next[!sched_next_cur].at, next);
+	sched_next[!sched_next_cur].armed = 1;
+	hal_preempt();
+	sched_next_cur = !sched_next_cur;
+}
+
+//***************************************************************************
+//
+// Function Name        : "sched_rebuild"
+// Date                 : 10/17/26
+// Version              : 1.2
+// Target MCU           : AVR128DB48
+// Target Hardware      ; none
+// Author               : Vanessa Li
+// DESCRIPTION
+// Refills the queue of a zone with the events that follow now, called
+// whenever its cycle restarts or its clean_time changes
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : sched_after()
+//
+// Revision History     : Initial version
+//						  v1.1 Deadlines on the 32 bit clock instead of
+//								second_counter values
+//						  v1.2 A queue per zone, sched_publish() is left
+//								to the caller
+//
+//**************************************************************************
+void sched_rebuild(uint8_t zone, uint32_t now, uint32_t start, uint16_t clean_at){
+	sched_event_t *queue = sched_queue[zone];
+	queue[0] = sched_after(now, start, clean_at);
+	for (uint8_t i = 1; i < SCHED_QUEUE_LEN; i++) {
+		queue[i] = sched_after(queue[i - 1].at, start, clean_at);
+	}
+}
+
+//drops the event of a zone that just fired and appends the next one
+void sched_advance(uint8_t zone, uint32_t start, uint16_t clean_at){
+	sched_event_t *queue = sched_queue[zone];
+	for (uint8_t i = 1; i < SCHED_QUEUE_LEN; i++) {
+		queue[i - 1] = queue[i];
+	}
+	queue[SCHED_QUEUE_LEN - 1] = sched_after(queue[SCHED_QUEUE_LEN - 2].at, start, clean_at);
+}
+
+//called from the one second tick, flags SCHED_EVENT once the earliest
+//deadline has passed and disarms it until the main loop publishes the
+//following one, and asks for a night check every second
+void sched_tick(uint32_t now){
+	uint8_t due = SCHED_NIGHT;
+	volatile sched_next_t *next = &sched_next[sched_next_cur];
+	if(next->armed && (int32_t)(now - next->at) >= 0) {
+		due |= SCHED_EVENT;
+		next->armed = 0;
+	}
+	sched_due |= due;
+}
+
+//returns the events that came due since the last call and clears them
+uint8_t sched_take_due(void){
+	uint8_t due;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		due = sched_due;
+		sched_due = 0;
+	}
+	return due;
+}
@@ -0,0 +1,243 @@
+/*
+ * screens.h
+ *
+ * Created: 10/17/2026 1:04:51 PM
+ *  Author: Brandon
+ */ 
+
+
+#ifndef SCREENS_H_
+#define SCREENS_H_
+
+#include <avr/pgmspace.h>
+
+//Every LCD screen is a fixed 4x20 character template kept in flash, plus a
+//list of slots where variable fields are written over the template. Drawing
+//a screen is a copy from flash into the line buffers followed by a few
+//field writes, see screen_render(). The fields themselves are filled in by
+//render_field() in main.c.
+#define SCREEN_COLS 20
+
+//variable fields, the width each one writes is given in brackets
+#define FIELD_NIGHT_MODE 0		//[3] " ON" or "OFF"
+#define FIELD_LAST_KIND 1		//[4] "CLN " or "FILL", last event
+#define FIELD_NEXT_KIND 2		//[4] next event
+#define FIELD_AFTER_KIND 3		//[4] event after the next one
+#define FIELD_SINCE 4			//[4] h:mm since the last event
+#define FIELD_NEXT_IN 5			//[4] h:mm until the next event
+#define FIELD_AFTER_IN 6		//[4] h:mm until the event after
+#define FIELD_FILLS 7			//[2] fills per clean
+#define FIELD_FILL_MIN 8		//[1] top off duration, minutes
+#define FIELD_FILL_SEC 9		//[2] top off duration, seconds
+#define FIELD_REMAINING 10		//[4] m:ss left of a fill or clean
+#define FIELD_IP 11				//[20] IP address sent over USART
+#define FIELD_AIN1 12			//[4] v.vv fill SSR
+#define FIELD_AIN2 13			//[4] v.vv BB2 SSR
+#define FIELD_AIN3 14			//[4] v.vv clean SSR
+#define FIELD_NIGHT_PROMPT 15	//[20] night mode question
+#define FIELD_POST_FILL 16		//[4] "GOOD" or "FAIL", POST of the fill SSR
+#define FIELD_POST_BB2 17		//[4] BB2 SSR
+#define FIELD_POST_CLEAN 18		//[4] clean SSR
+#define FIELD_POST_SOLAR 19		//[4] solar panel
+#define FIELD_ZONE 20			//[2] "Z1" for zone_sel, blank with one zone
+#define FIELD_ZONE_KEY 21		//[4] "ZONE" key label, blank with one zone
+
+typedef struct {
+	uint8_t line;
+	uint8_t col;
+	uint8_t field;
+} screen_slot_t;
+
+typedef struct {
+	char mode;
+	const char *text;				//4 lines of SCREEN_COLS characters, in flash
+	const screen_slot_t *slots;		//in flash
+	uint8_t slot_count;
+} screen_t;
+
+const char screen_text_d[] PROGMEM =
+	"                    "
+	"   SYSTEM DISABLED  "
+	"                    "
+	"                ENBL";
+const char screen_text_h[] PROGMEM =
+	"LAST NEXT NEXT    NM"
+	"CLN  FILL FILL   OFF"
+	"0:00 0:00 1:00      "
+	"MODE DIAG CLEAN FILL";
+const screen_slot_t screen_slots_h[] PROGMEM = {
+	{1, 0, FIELD_LAST_KIND}, {1, 5, FIELD_NEXT_KIND}, {1, 10, FIELD_AFTER_KIND},
+	{1, 17, FIELD_NIGHT_MODE},
+	{2, 0, FIELD_SINCE}, {2, 5, FIELD_NEXT_IN}, {2, 10, FIELD_AFTER_IN},
+	{2, 18, FIELD_ZONE}
+};
+const char screen_text_l[] PROGMEM =
+	"Fill Every Hour     "
+	"How many Fills?     "
+	" 2 Fills per 1 Clean"
+	"INC  DEC  CLEAN HOME";
+const screen_slot_t screen_slots_l[] PROGMEM = {
+	{2, 0, FIELD_FILLS}
+};
+const char screen_text_i[] PROGMEM =
+	"Duration of fill?   "
+	"0m 20s              "
+	"                    "
+	"INC  DEC  HOME  FILL";
+const screen_slot_t screen_slots_i[] PROGMEM = {
+	{1, 0, FIELD_FILL_MIN}, {1, 3, FIELD_FILL_SEC}
+};
+const char screen_text_e[] PROGMEM =
+	"DISABLE SYSTEM?     "
+	"                    "
+	"                    "
+	"YES    NO           ";
+const char screen_text_n[] PROGMEM =
+	"                    "
+	"                    "
+	"                    "
+	"YES    NO           ";
+const screen_slot_t screen_slots_n[] PROGMEM = {
+	{0, 0, FIELD_NIGHT_PROMPT}
+};
+const char screen_text_f[] PROGMEM =
+	"Currently Filling   "
+	"Time Remaining: 0:00"
+	"                    "
+	"Any Button to Cancel";
+const char screen_text_c[] PROGMEM =
+	"Currently Cleaning  "
+	"Time Remaining: 0:00"
+	"                    "
+	"Any Button to Cancel";
+const screen_slot_t screen_slots_fc[] PROGMEM = {
+	{1, 16, FIELD_REMAINING}, {2, 18, FIELD_ZONE}
+};
+const char screen_text_m[] PROGMEM =
+	"Select an option:   "
+	"                    "
+	"                    "
+	"DSBL  NM        HOME";
+const screen_slot_t screen_slots_m[] PROGMEM = {
+	{2, 0, FIELD_IP}, {3, 10, FIELD_ZONE_KEY}
+};
+const char screen_text_a[] PROGMEM =
+	"SSR1 SSR2  SSR3  SOL"
+	"0.00 0.00  0.00     "
+	"                    "
+	"                HOME";
+const screen_slot_t screen_slots_a[] PROGMEM = {
+	{1, 0, FIELD_AIN1}, {1, 5, FIELD_AIN2}, {1, 11, FIELD_AIN3}
+};
+const char screen_text_g[] PROGMEM =
+	"                    "
+	"     NIGHT MODE     "
+	"                    "
+	"                DSBL";
+const char screen_text_p[] PROGMEM =
+	"Power-On Self Tests "
+	"FILL-GOOD  WIFI-GOOD"
+	" CLN-GOOD  SOLR-GOOD"
+	" BB2-GOOD           ";
+const screen_slot_t screen_slots_p[] PROGMEM = {
+	{1, 5, FIELD_POST_FILL}, {2, 5, FIELD_POST_CLEAN}, {2, 16, FIELD_POST_SOLAR},
+	{3, 5, FIELD_POST_BB2}
+};
+const char screen_prompt_nm_on[] PROGMEM = "Turn on night mode? ";
+const char screen_prompt_nm_off[] PROGMEM = "Turn off night mode?";
+
+#define SCREEN(mode, text, slots) {mode, text, slots, sizeof(slots) / sizeof(screen_slot_t)}
+const screen_t screens[] PROGMEM = {
+	{'d', screen_text_d, 0, 0},
+	SCREEN('h', screen_text_h, screen_slots_h),
+	SCREEN('l', screen_text_l, screen_slots_l),
+	SCREEN('i', screen_text_i, screen_slots_i),
+	{'e', screen_text_e, 0, 0},
+	SCREEN('n', screen_text_n, screen_slots_n),
+	SCREEN('f', screen_text_f, screen_slots_fc),
+	SCREEN('c', screen_text_c, screen_slots_fc),
+	SCREEN('m', screen_text_m, screen_slots_m),
+	SCREEN('a', screen_text_a, screen_slots_a),
+	{'g', screen_text_g, 0, 0},
+	SCREEN('p', screen_text_p, screen_slots_p)		//POST results while booting
+};
+#define SCREEN_COUNT (sizeof(screens) / sizeof(screen_t))
+
+void screen_render(char mode);
+void render_field(uint8_t field, char *dst);
+void screen_put_dec(char *dst, uint8_t width, uint16_t value, char pad);
+void screen_put_time(char *dst, uint16_t value);
+void screen_put_mv(char *dst, uint16_t mv);
+
+#endif /* SCREENS_H_ */
+
+//writes value right aligned into width characters, padded with pad
+void screen_put_dec(char *dst, uint8_t width, uint16_t value, char pad){
+	char *digit = dst + width;
+	do {
+		*--digit = '0' + value % 10;
+		value /= 10;
+	} while(value && digit != dst);
+	while(digit != dst) {
+		*--digit = pad;
+	}
+}
+
+//writes value as x:yy with x = value / 60, so minutes come out as h:mm and
+//seconds as m:ss
+void screen_put_time(char *dst, uint16_t value){
+	dst[0] = '0' + value / 60;
+	dst[1] = ':';
+	screen_put_dec(&dst[2], 2, value % 60, '0');
+}
+
+//writes a millivolt reading as v.vv
+void screen_put_mv(char *dst, uint16_t mv){
+	dst[0] = '0' + mv / 1000;
+	dst[1] = '.';
+	screen_put_dec(&dst[2], 2, (mv % 1000) / 10, '0');
+}
+
+//***************************************************************************
+//
+// Function Name        : "screen_render"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; ST7036 + LCD
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Copies the template for mode from flash into the four line buffers and
+// has render_field() write each of its variable fields
+//
+// Warnings             : none
+// Restrictions         : Modes without a template leave the buffers alone
+// Algorithms           : none
+// References           : render_field()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void screen_render(char mode){
+	char *lines[4] = {dsp_buff1, dsp_buff2, dsp_buff3, dsp_buff4};
+	const screen_t *screen = screens;
+	const char *text;
+	const screen_slot_t *slot;
+	uint8_t slot_count;
+	
+	while(pgm_read_byte(&screen->mode) != mode) {
+		if(++screen == &screens[SCREEN_COUNT])
+			return;
+	}
+	text = pgm_read_ptr(&screen->text);
+	for (uint8_t line = 0; line < 4; line++) {
+		memcpy_P(lines[line], text + line * SCREEN_COLS, SCREEN_COLS);
+		lines[line][SCREEN_COLS] = '\0';
+	}
+	slot = pgm_read_ptr(&screen->slots);
+	slot_count = pgm_read_byte(&screen->slot_count);
+	for (uint8_t i = 0; i < slot_count; i++, slot++) {
+		render_field(pgm_read_byte(&slot->field),
+			&lines[pgm_read_byte(&slot->line)][pgm_read_byte(&slot->col)]);
+	}
+}
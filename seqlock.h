@@ -0,0 +1,57 @@
+/*
+ * seqlock.h
+ *
+ * Created: 10/18/2026 3:02:14 AM
+ *  Author: Vanessa
+ */
+
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+//Sharing state between the ISRs and the main loop without turning
+//interrupts off. Which pattern depends on who writes:
+//
+//An ISR writes, the main loop reads: a sequence lock. The ISR counts the
+//sequence number up before and after it writes, so the number is odd while
+//a write is under way. The main loop copies the data between
+//seq_read_begin() and seq_read_retry() and copies it again if the number
+//was odd or has changed meanwhile. The ISR can not be interrupted by the
+//main loop, so the copy is retried at most once per interrupt that hits it.
+//	do {
+//		start = seq_read_begin(&clock_seq);
+//		HAL_COPY(now, clock_seconds);
+//	} while(seq_read_retry(&clock_seq, start));
+//
+//The main loop writes, an ISR reads: a double buffered block. The main
+//loop fills the copy the ISR is not using and then flips the index, a
+//single byte store, see zone_publish() in main.c and telemetry_zones_flip().
+//
+//Values wider than a byte are copied to and from the shared state with
+//HAL_COPY(), which the host build splits into bytes with a chance for an
+//interrupt before each one, see host/stress.c.
+//
+//A take-and-clear of flags that both sides change, like button_press,
+//still needs the short ATOMIC_BLOCK, there the main loop writes too.
+//The shared data must be volatile, so the compiler keeps its accesses
+//between the ones of the sequence number.
+typedef volatile uint8_t seq_t;
+
+#endif /* SEQLOCK_H_ */
+
+//called by the ISR before and after it writes the data of seq
+static inline void seq_write(seq_t *seq) {
+	(*seq)++;
+}
+
+//starts a read of the data of seq, returns what seq_read_retry() needs
+static inline uint8_t seq_read_begin(seq_t *seq) {
+	return *seq;
+}
+
+//returns 1 if an ISR wrote the data of seq since seq_read_begin() returned
+//start, the copy has to be taken again
+static inline uint8_t seq_read_retry(seq_t *seq, uint8_t start) {
+	hal_preempt();
+	return (start & 1) || *seq != start;
+}
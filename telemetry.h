@@ -0,0 +1,271 @@
+/*
+ * telemetry.h
+ *
+ * Created: 10/17/2026 9:12:40 AM
+ *  Author: Brandon
+ */ 
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+//Once a second the RTC ISR takes a snapshot of the schedule state and the
+//main loop sends it out. By default the snapshot goes out as one binary
+//frame, COBS encoded and terminated by 0x00:
+//	byte 0		TELEMETRY_FRAME_STATUS
+//	byte 1		sequence number, increments every frame
+//	byte 2-3	second_counter, little endian
+//	byte 4-5	clean_time, little endian
+//	byte 6-7	delay_end, little endian
+//	byte 8		mode
+//	byte 9		zone, from 0, see zone.h
+//	byte 10-11	CRC-16/XMODEM of bytes 0-9, little endian
+//With several zones the snapshots take turns between them, one a second.
+//Neither side turns interrupts off for the other, see seqlock.h. The ISR
+//reads the zones from telemetry_zones, a double buffered copy the main
+//loop refreshes every pass, and writes the snapshot under telemetry_snap_seq.
+//The text lines sent before this frame existed are kept for bench debugging
+//and are selected with the "telem text" USART command.
+#define TELEMETRY_FRAME_STATUS 0x01
+#define TELEMETRY_STATUS_LEN 10		//frame length without the CRC
+#define TELEMETRY_MAX_FRAME 64		//largest frame telemetry_send_frame accepts
+#ifndef TELEMETRY_TEXT_DEFAULT
+#define TELEMETRY_TEXT_DEFAULT 0
+#endif
+
+typedef struct {
+	uint16_t second_counter;
+	uint16_t clean_time;
+	uint16_t delay_end;
+	char mode;
+	uint8_t zone;
+} telemetry_snapshot_t;
+
+//what the RTC ISR reports of a zone, kept up by the main loop
+typedef struct {
+	uint32_t cycle_start;
+	uint32_t delay_end;
+	uint16_t clean_time;
+	char mode;
+} telemetry_zone_t;
+
+volatile telemetry_snapshot_t telemetry_snap;
+seq_t telemetry_snap_seq = 0;				//bumped by the ISR around telemetry_snap writes
+uint8_t telemetry_sent = 0;					//telemetry_snap_seq of the last snapshot sent
+volatile telemetry_zone_t telemetry_zones[2][ZONES];	//the ISR reads telemetry_zones[telemetry_zones_cur]
+volatile uint8_t telemetry_zones_cur = 0;
+uint8_t telemetry_seq = 0;
+uint8_t telemetry_text = TELEMETRY_TEXT_DEFAULT;	//1 sends the old text lines
+
+void telemetry_capture(uint8_t zone, uint16_t second_counter, uint16_t clean_time, uint16_t delay_end, char mode);
+volatile telemetry_zone_t *telemetry_zones_next(void);
+void telemetry_zones_flip(void);
+uint8_t telemetry_snap_read(telemetry_snapshot_t *snap);
+void telemetry_task(void);
+uint8_t cobs_encode(const uint8_t *data, uint8_t len, uint8_t *out);
+uint8_t cobs_decode(uint8_t *data, uint8_t len);
+void telemetry_send_frame(const uint8_t *data, uint8_t len);
+
+#endif /* TELEMETRY_H_ */
+
+//stores a snapshot for telemetry_task to send, called from the RTC ISR
+void telemetry_capture(uint8_t zone, uint16_t second_counter, uint16_t clean_time, uint16_t delay_end, char mode){
+	seq_write(&telemetry_snap_seq);
+	telemetry_snap.zone = zone;
+	telemetry_snap.second_counter = second_counter;
+	telemetry_snap.clean_time = clean_time;
+	telemetry_snap.delay_end = delay_end;
+	telemetry_snap.mode = mode;
+	seq_write(&telemetry_snap_seq);
+}
+
+//returns the copy of the zones the ISR is not reading, the main loop fills
+//in every zone and then calls telemetry_zones_flip()
+volatile telemetry_zone_t *telemetry_zones_next(void){
+	return telemetry_zones[!telemetry_zones_cur];
+}
+
+//hands the copy filled in through telemetry_zones_next() to the ISR, the
+//one byte store takes effect between two of its reads of the zones
+void telemetry_zones_flip(void){
+	telemetry_zones_cur = !telemetry_zones_cur;
+}
+
+//***************************************************************************
+//
+// Function Name        : "cobs_encode"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; none
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Encodes len bytes of data with Consistent Overhead Byte Stuffing so the
+// result contains no 0x00 bytes. Returns the number of bytes written to out.
+//
+// Warnings             : none
+// Restrictions         : out must hold len + 1 bytes, len must be below 254
+// Algorithms           : COBS
+// References           : none
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+uint8_t cobs_encode(const uint8_t *data, uint8_t len, uint8_t *out){
+	uint8_t code_pos = 0;	//where the code byte of the current block goes
+	uint8_t out_len = 1;
+	uint8_t code = 1;
+	for (uint8_t i = 0; i < len; i++) {
+		if(data[i] == 0) {
+			out[code_pos] = code;
+			code_pos = out_len++;
+			code = 1;
+		}else {
+			out[out_len++] = data[i];
+			code++;
+		}
+	}
+	out[code_pos] = code;
+	return out_len;
+}
+
+//***************************************************************************
+//
+// Function Name        : "cobs_decode"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; none
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Decodes len bytes of a COBS block, without the 0x00 delimiter, in place.
+// Returns the number of decoded bytes, or 0 if the block is not valid COBS.
+//
+// Warnings             : none
+// Restrictions         : len must be below 255
+// Algorithms           : COBS
+// References           : cobs_encode()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+uint8_t cobs_decode(uint8_t *data, uint8_t len){
+	uint8_t in = 0;
+	uint8_t out = 0;
+	uint8_t code;
+	while(in < len) {
+		code = data[in++];
+		if(code == 0 || in + code - 1 > len)
+			return 0;
+		for (uint8_t i = 1; i < code; i++) {
+			data[out++] = data[in++];
+		}
+		if(code < 0xFF && in < len)
+			data[out++] = 0;	//the zero this block stood for
+	}
+	return out;
+}
+
+//***************************************************************************
+//
+// Function Name        : "telemetry_send_frame"
+// Date                 : 10/17/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; USART0 output
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Appends a CRC-16/XMODEM to len bytes of data, COBS encodes the result and
+// writes it to stdout followed by the 0x00 frame delimiter
+//
+// Warnings             : none
+// Restrictions         : len must not be above TELEMETRY_MAX_FRAME - 2
+// Algorithms           : none
+// References           : cobs_encode()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void telemetry_send_frame(const uint8_t *data, uint8_t len){
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	uint8_t encoded[TELEMETRY_MAX_FRAME + 1];
+	uint16_t crc = 0;
+	uint8_t encoded_len;
+	for (uint8_t i = 0; i < len; i++) {
+		frame[i] = data[i];
+		crc = _crc_xmodem_update(crc, data[i]);
+	}
+	frame[len] = crc & 0xFF;
+	frame[len + 1] = crc >> 8;
+	encoded_len = cobs_encode(frame, len + 2, encoded);
+	for (uint8_t i = 0; i < encoded_len; i++) {
+		putchar(encoded[i]);
+	}
+	putchar(0x00);
+}
+
+//copies the latest snapshot into snap, returns telemetry_snap_seq it was
+//copied at
+uint8_t telemetry_snap_read(telemetry_snapshot_t *snap){
+	uint8_t start;
+	do {
+		start = seq_read_begin(&telemetry_snap_seq);
+		HAL_COPY(snap->second_counter, telemetry_snap.second_counter);
+		HAL_COPY(snap->clean_time, telemetry_snap.clean_time);
+		HAL_COPY(snap->delay_end, telemetry_snap.delay_end);
+		HAL_COPY(snap->mode, telemetry_snap.mode);
+		HAL_COPY(snap->zone, telemetry_snap.zone);
+	} while(seq_read_retry(&telemetry_snap_seq, start));
+	return start;
+}
+
+//***************************************************************************
+//
+// Function Name        : "telemetry_task"
+// Date                 : 10/17/26
+// Version              : 1.3
+// Target MCU           : AVR128DB48
+// Target Hardware      ; USART0 output
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Called from the main loop. Sends the snapshot taken by the RTC ISR, as a
+// binary status frame or as the old text lines if telemetry_text is set.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : telemetry_capture(), telemetry_send_frame()
+//
+// Revision History     : Initial version
+//						  v1.1 Zone byte
+//						  v1.2 Copies the snapshot under telemetry_snap_seq
+//								with interrupts on
+//						  v1.3 The copy is telemetry_snap_read()
+//
+//**************************************************************************
+void telemetry_task(void){
+	telemetry_snapshot_t snap;
+	uint8_t frame[TELEMETRY_STATUS_LEN];
+	if(telemetry_snap_seq == telemetry_sent)
+		return;
+	telemetry_sent = telemetry_snap_read(&snap);
+	if(telemetry_text) {
+		printf("second_counter=%u\n", snap.second_counter);
+		printf("clean_time=%u\n", snap.clean_time);
+		printf("delay_end=%u\n", snap.delay_end);
+		printf("mode=%c\n", snap.mode);
+		printf("zone=%u\n", snap.zone + 1);
+		return;
+	}
+	frame[0] = TELEMETRY_FRAME_STATUS;
+	frame[1] = telemetry_seq++;
+	frame[2] = snap.second_counter & 0xFF;
+	frame[3] = snap.second_counter >> 8;
+	frame[4] = snap.clean_time & 0xFF;
+	frame[5] = snap.clean_time >> 8;
+	frame[6] = snap.delay_end & 0xFF;
+	frame[7] = snap.delay_end >> 8;
+	frame[8] = snap.mode;
+	frame[9] = snap.zone;
+	telemetry_send_frame(frame, TELEMETRY_STATUS_LEN);
+}
@@ -0,0 +1,304 @@
+/*
+ * valve.h
+ *
+ * Created: 10/18/2026 12:12:40 AM
+ *  Author: Vanessa
+ */
+
+
+#ifndef VALVE_H_
+#define VALVE_H_
+
+//Valve driver. Every valve pin, and ENAC-, is turned on and off through
+//valve_open() and valve_close(), which keep the pins that are on in
+//valve_on_a and valve_on_d. Pins that are already in the asked state are
+//not written again, and valve_on_* tell what is open without reading the
+//ports. The driver holds interlocks, pairs of valve sets that must never
+//be open together, like the fill and clean valve of a zone. valve_open()
+//refuses to open a pin that would break one and counts it in
+//valve_lock_trips. Only valve_test() may open both sides at once, for the
+//POST and the diagnostics screen, which sense every SSR switched on.
+//Zones and the test hold their pins apart, in valve_held_* and valve_test_*,
+//and a pin is on while either holds it. So ENAC- stays on for a running
+//zone when the test lets go of it, and the other way round. The test
+//leaves out a pin that would break an interlock with a pin a zone holds,
+//and a zone that opens takes such pins back from the test.
+//
+//Valve timing. The main loop opens the valves, then arms a timer with the
+//time they stay open and the pins to turn off. While a timer is armed TCB3
+//interrupts every millisecond and its ISR turns the pins off on the tick
+//the timer runs out, so a fill lasts its time to the millisecond however
+//long the main loop is busy. The main loop only learns about it afterwards,
+//through valve_take_expired(). TCB3 is stopped when no timer is armed.
+//The ISR closes valves as well, so the main loop changes valve_on_* and
+//the pins together with interrupts off, and only through OUTSET and
+//OUTCLR, a read-modify-write of OUT could turn a valve the ISR just closed
+//back on.
+//Every zone, see zone.h, has two timers. The ISR only looks at the armed
+//ones, and only zones that hold the water supply have any armed, so its
+//cost does not grow with the number of zones. When the end timer of the
+//last open zone runs out the ISR turns ENAC- off as well, so the supply is
+//shut on time without the main loop. A zone waiting for the supply turns it
+//back on when the main loop opens it.
+#ifndef ZONES
+#define ZONES 1						//bird baths on this controller, at most 8
+#endif
+#if ZONES < 1 || ZONES > 8
+#error "ZONES must be 1 to 8"
+#endif
+#define VALVE_TIMERS (2 * ZONES)
+#define VALVE_TIMER_END(zone) ((zone) * 2)		//end of a fill or clean
+#define VALVE_TIMER_BB2(zone) ((zone) * 2 + 1)	//BB2 closing part way into a clean
+#define VALVE_END_TIMERS (0x5555 & ((1UL << VALVE_TIMERS) - 1))	//bits of every end timer
+#define VALVE_MS_TICKS 1999			//1ms at F_CPU/2, the period is CCMP + 1
+#define VALVE_LOCKS ZONES			//interlocks, one per zone
+
+volatile uint8_t valve_on_a = 0;				//PORTA valve pins that are on
+volatile uint8_t valve_on_d = 0;				//PORTD valve pins that are on
+volatile uint8_t valve_held_a = 0;				//PORTA pins opened by valve_open()
+volatile uint8_t valve_held_d = 0;				//PORTD pins opened by valve_open()
+uint8_t valve_test_a = 0;						//PORTA pins valve_test() holds on
+uint8_t valve_test_d = 0;						//PORTD pins valve_test() holds on
+uint8_t valve_lock_a[VALVE_LOCKS][2];			//PORTA pins of the two sides of each interlock
+uint8_t valve_lock_d[VALVE_LOCKS][2];			//PORTD pins of them
+uint16_t valve_lock_trips = 0;					//opens refused by an interlock
+
+volatile uint32_t valve_ms_left[VALVE_TIMERS];	//ms left of each armed timer
+uint8_t valve_off_a[VALVE_TIMERS];				//PORTA pins a timer turns off
+uint8_t valve_off_d[VALVE_TIMERS];				//PORTD pins a timer turns off
+volatile uint16_t valve_armed = 0;				//bit per timer that is counting
+volatile uint16_t valve_expired = 0;			//bit per timer that ran out
+
+void valve_interlock(uint8_t lock, uint8_t a1, uint8_t d1, uint8_t a2, uint8_t d2);
+uint8_t valve_open(uint8_t a, uint8_t d);
+void valve_close(uint8_t a, uint8_t d);
+void valve_test(uint8_t on);
+void valve_arm(uint8_t timer, uint32_t ms, uint8_t off_a, uint8_t off_d);
+void valve_disarm(uint8_t timer);
+uint16_t valve_take_expired(void);
+
+#endif /* VALVE_H_ */
+
+//closes the pins of a and d for the zones, with interrupts off or from the
+//ISR. Pins valve_test() holds stay on.
+static inline void valve_drive_off(uint8_t a, uint8_t d){
+	valve_held_a &= ~a;
+	valve_held_d &= ~d;
+	a &= valve_on_a & ~valve_test_a;
+	d &= valve_on_d & ~valve_test_d;
+	board_valves_off(a, d);
+	valve_on_a &= ~a;
+	valve_on_d &= ~d;
+}
+
+//sets an interlock, the PORTA pins a1 and PORTD pins d1 are never open
+//together with the PORTA pins a2 and PORTD pins d2
+void valve_interlock(uint8_t lock, uint8_t a1, uint8_t d1, uint8_t a2, uint8_t d2){
+	valve_lock_a[lock][0] = a1;
+	valve_lock_d[lock][0] = d1;
+	valve_lock_a[lock][1] = a2;
+	valve_lock_d[lock][1] = d2;
+}
+
+//***************************************************************************
+//
+// Function Name        : "valve_open"
+// Date                 : 10/18/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; SSRs
+// Author               : Vanessa Li
+// DESCRIPTION
+// Turns on the PORTA pins a and the PORTD pins d, the ones that are not on
+// already, and holds them for the zones. If that would open both sides of
+// an interlock with the pins the zones hold nothing is turned on,
+// valve_lock_trips is counted and 0 returned, otherwise 1. Pins
+// valve_test() holds on the other side of an interlock are turned off.
+//
+// Warnings             : none
+// Restrictions         : Main loop only
+// Algorithms           : none
+// References           : valve_interlock(), valve_test()
+//
+// Revision History     : Initial version
+//						  v1.1 Only the zones' pins count, the test gives
+//								way
+//
+//**************************************************************************
+uint8_t valve_open(uint8_t a, uint8_t d){
+	uint8_t on_a;
+	uint8_t on_d;
+	uint8_t drop_a = 0;		//test pins that have to give way
+	uint8_t drop_d = 0;
+	uint8_t ok = 1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		on_a = valve_held_a | a;
+		on_d = valve_held_d | d;
+		for (uint8_t i = 0; i < VALVE_LOCKS; i++) {
+			for (uint8_t side = 0; side < 2; side++) {
+				//only the interlocks the new pins are part of
+				if(!((a & valve_lock_a[i][side]) || (d & valve_lock_d[i][side])))
+					continue;
+				if((on_a & valve_lock_a[i][!side]) || (on_d & valve_lock_d[i][!side]))
+					ok = 0;
+				drop_a |= valve_lock_a[i][!side];
+				drop_d |= valve_lock_d[i][!side];
+			}
+		}
+		if(ok) {
+			drop_a &= valve_test_a & ~a;
+			drop_d &= valve_test_d & ~d;
+			valve_test_a &= ~drop_a;
+			valve_test_d &= ~drop_d;
+			board_valves_off(drop_a & valve_on_a, drop_d & valve_on_d);
+			board_valves_on(a & ~valve_on_a, d & ~valve_on_d);
+			valve_held_a = on_a;
+			valve_held_d = on_d;
+			valve_on_a = on_a | valve_test_a;
+			valve_on_d = on_d | valve_test_d;
+		}else {
+			valve_lock_trips++;
+		}
+	}
+	return ok;
+}
+
+//turns off the PORTA pins a and the PORTD pins d, the ones that are on
+void valve_close(uint8_t a, uint8_t d){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		valve_drive_off(a, d);
+	}
+}
+
+//holds every SSR of the board on, or lets go of them again, past the
+//interlocks among them. For the POST and the diagnostics screen, which sense
+//the SSRs switched on. An SSR that would break an interlock with a pin a
+//zone holds is left out, and letting go turns off only what no zone holds.
+void valve_test(uint8_t on){
+	uint8_t a = 0;
+	uint8_t d = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(on) {
+			a = BOARD_SSR_A;
+			d = BOARD_SSR_D;
+			for (uint8_t i = 0; i < VALVE_LOCKS; i++) {
+				for (uint8_t side = 0; side < 2; side++) {
+					if((valve_held_a & valve_lock_a[i][side]) || (valve_held_d & valve_lock_d[i][side])) {
+						a &= ~valve_lock_a[i][!side];
+						d &= ~valve_lock_d[i][!side];
+					}
+				}
+			}
+		}
+		board_valves_off(valve_on_a & ~(valve_held_a | a), valve_on_d & ~(valve_held_d | d));
+		board_valves_on(a & ~valve_on_a, d & ~valve_on_d);
+		valve_test_a = a;
+		valve_test_d = d;
+		valve_on_a = valve_held_a | a;
+		valve_on_d = valve_held_d | d;
+	}
+}
+
+//***************************************************************************
+//
+// Function Name        : "valve_arm"
+// Date                 : 10/18/26
+// Version              : 1.1
+// Target MCU           : AVR128DB48
+// Target Hardware      ; TCB3, SSRs
+// Author               : Vanessa Li
+// DESCRIPTION
+// Has the PORTA pins off_a and the PORTD pins off_d turned off ms
+// milliseconds from now, and the timer's bit set in valve_expired. Arming
+// a timer that is already armed starts it over.
+//
+// Warnings             : none
+// Restrictions         : ms must not be 0
+// Algorithms           : none
+// References           : TCB3 ISR
+//
+// Revision History     : Initial version
+//						  v1.1 Unsigned timer bits, timer 15 too
+//
+//**************************************************************************
+void valve_arm(uint8_t timer, uint32_t ms, uint8_t off_a, uint8_t off_d){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(!(TCB3.CTRLA & TCB_ENABLE_bm)) {		//idle, start on a whole tick
+			TCB3.CCMP = VALVE_MS_TICKS;
+			TCB3.CNT = 0;
+			TCB3.CTRLB = TCB_CNTMODE_INT_gc;	//periodic interrupt mode
+			TCB3.INTCTRL = TCB_CAPT_bm;
+			TCB3.CTRLA = TCB_CLKSEL_DIV2_gc | TCB_ENABLE_bm;
+		}
+		valve_off_a[timer] = off_a;
+		valve_off_d[timer] = off_d;
+		valve_ms_left[timer] = ms;
+		valve_armed |= 1U << timer;
+		valve_expired &= (uint16_t)~(1U << timer);
+	}
+}
+
+//stops a timer without touching the pins
+void valve_disarm(uint8_t timer){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		valve_armed &= (uint16_t)~(1U << timer);
+		valve_expired &= (uint16_t)~(1U << timer);
+	}
+}
+
+//returns the timers that ran out since the last call, as bits
+uint16_t valve_take_expired(void){
+	uint16_t expired;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		expired = valve_expired;
+		valve_expired = 0;
+	}
+	return expired;
+}
+
+//***************************************************************************
+//
+// Function Name        : "TCB3 ISR"
+// Date                 : 10/18/26
+// Version              : 1.4
+// Target MCU           : AVR128DB48
+// Target Hardware      ; TCB3, SSRs
+// Author               : Vanessa Li
+// DESCRIPTION
+// Runs every millisecond while a valve timer is armed. Counts the armed
+// timers down, turns off the pins of each one that runs out and flags it
+// in valve_expired. Turns ENAC- off once the last end timer ran out. Stops
+// TCB3 once no timer is left.
+//
+// Warnings             : none
+// Restrictions         : none
+// Algorithms           : none
+// References           : valve_arm()
+//
+// Revision History     : Initial version
+//						  v1.1 Timers per zone, only the armed ones are
+//								visited
+//						  v1.2 Closes through the valve driver
+//						  v1.3 Turns ENAC- off after the last zone
+//						  v1.4 Unsigned timer bits
+//
+//**************************************************************************
+ISR(TCB3_INT_vect){
+	uint16_t armed = valve_armed;
+	uint16_t ran_out = 0;
+	for (uint8_t i = 0; armed; i++, armed >>= 1) {
+		if(!(armed & 1))
+			continue;
+		if(--valve_ms_left[i] == 0) {
+			valve_drive_off(valve_off_a[i], valve_off_d[i]);
+			ran_out |= 1U << i;
+		}
+	}
+	valve_armed &= ~ran_out;
+	valve_expired |= ran_out;
+	if((ran_out & VALVE_END_TIMERS) && !(valve_armed & VALVE_END_TIMERS))
+		valve_drive_off(0, BOARD_ENAC_D);	//no zone is open any more
+	if(!valve_armed)
+		TCB3.CTRLA = 0;
+	TCB3.INTFLAGS = TCB_CAPT_bm; //clear interrupt flag
+}
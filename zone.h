@@ -0,0 +1,197 @@
+/*
+ * zone.h
+ *
+ * Created: 10/18/2026 1:04:26 AM
+ *  Author: Brandon
+ */
+
+
+#ifndef ZONE_H_
+#define ZONE_H_
+
+#include <avr/pgmspace.h>
+
+//Several bird baths can run off one controller, ZONES of them, see valve.h.
+//Each zone has its own valves, schedule and state machine. Per zone state
+//is kept as arrays indexed by the zone number, here and in main.c. The
+//state machine actions work on zone_cur, the zone an event is dispatched
+//to. The LCD shows zone_sel, and commands go to it unless they name a zone.
+//Outside of fsm_dispatch zone_cur is zone_sel.
+//The zones share one water supply, at most ZONE_SUPPLY_MAX of them may
+//have their valves open at once. A zone that starts a fill or clean while
+//the supply is taken waits its turn in zone_queue and is opened as soon as
+//a running zone closes, so fills that fall on the same hour run one after
+//the other. Its state machine is already in the fill or clean state while
+//it waits. ENAC- is shared and stays on while any zone is open.
+#ifndef ZONE_SUPPLY_MAX
+#define ZONE_SUPPLY_MAX 1			//zones that may take water at the same time
+#endif
+#define ZONE_FILL 0					//what zone_request opens
+#define ZONE_CLEAN 1
+
+//pins of the valves of a zone, every valve may be on PORTA or PORTD
+typedef struct {
+	uint8_t fill_a, fill_d;
+	uint8_t clean_a, clean_d;
+	uint8_t bb2_a, bb2_d;
+} zone_pins_t;
+
+//valve pins of every zone. Zone 0 defaults to the valves in board.h. A
+//build with more zones lists them all.
+#ifndef ZONE_PINS
+#if ZONES > 1
+#error "ZONE_PINS must list the valve pins of every zone"
+#endif
+#define ZONE_PINS {BOARD_FILL_A, BOARD_FILL_D, BOARD_CLEAN_A, BOARD_CLEAN_D, BOARD_BB2_A, BOARD_BB2_D}
+#endif
+const zone_pins_t zone_pins[ZONES] PROGMEM = {ZONE_PINS};
+
+uint8_t zone_sel = 0;				//zone on the LCD and addressed by commands
+uint8_t zone_cur = 0;				//zone the state machine is running for
+uint32_t zone_delay_end[ZONES];		//clock_seconds when the running fill or clean ends,
+									//rounded up, for the screen and telemetry
+uint8_t zone_what[ZONES];			//ZONE_FILL or ZONE_CLEAN, what the zone opens
+uint16_t zone_ms[ZONES];			//how long it stays open
+uint16_t zone_bb2_ms[ZONES];		//when BB2 closes during a clean, 0 for never
+uint8_t zone_open = 0;				//bit per zone with its valves open
+uint8_t zone_open_count = 0;
+uint8_t zone_done = 0;				//bit per zone whose time ran out
+uint8_t zone_queue[ZONES];			//zones waiting for the supply, oldest first
+uint8_t zone_queued = 0;
+
+void zone_init(void);
+void zone_request(uint8_t zone, uint8_t what, uint16_t ms, uint16_t bb2_ms);
+void zone_release(uint8_t zone);
+void zone_task(void);
+uint8_t zone_take_done(uint8_t zone);
+
+#endif /* ZONE_H_ */
+
+//makes the valve pins of every zone and ENAC- outputs, and keeps the fill
+//and clean valve of each zone from opening together
+void zone_init(void){
+	zone_pins_t pins;
+	for (uint8_t zone = 0; zone < ZONES; zone++) {
+		memcpy_P(&pins, &zone_pins[zone], sizeof(pins));
+		PORTA.DIR |= pins.fill_a | pins.clean_a | pins.bb2_a;
+		PORTD.DIR |= pins.fill_d | pins.clean_d | pins.bb2_d;
+		valve_interlock(zone, pins.fill_a, pins.fill_d, pins.clean_a, pins.clean_d);
+	}
+	PORTD.DIR |= BOARD_ENAC_D;
+}
+
+//opens the valves of a zone and starts its timers. Returns 0 if an
+//interlock kept the valves closed, nothing is started then.
+uint8_t zone_start(uint8_t zone){
+	zone_pins_t pins;
+	memcpy_P(&pins, &zone_pins[zone], sizeof(pins));
+	if(zone_what[zone] == ZONE_CLEAN) {
+		if(!valve_open(pins.clean_a | pins.bb2_a, pins.clean_d | pins.bb2_d | BOARD_ENAC_D)) //open clean valve and BB2 valve and enable ENAC-
+			return 0;
+		valve_arm(VALVE_TIMER_END(zone), zone_ms[zone], pins.clean_a | pins.bb2_a, pins.clean_d | pins.bb2_d);
+		if(zone_bb2_ms[zone])
+			valve_arm(VALVE_TIMER_BB2(zone), zone_bb2_ms[zone], pins.bb2_a, pins.bb2_d);
+	}else {
+		if(!valve_open(pins.fill_a | pins.bb2_a, pins.fill_d | pins.bb2_d | BOARD_ENAC_D)) //open fill valve and BB2 valve and enable ENAC-
+			return 0;
+		valve_arm(VALVE_TIMER_END(zone), zone_ms[zone], pins.fill_a | pins.bb2_a, pins.fill_d | pins.bb2_d);
+	}
+	zone_delay_end[zone] = clock_now() + (zone_ms[zone] + 999) / 1000;
+	zone_open |= 1 << zone;
+	zone_open_count++;
+	return 1;
+}
+
+//opens waiting zones while the supply allows, and turns ENAC- off once no
+//zone is open. A zone an interlock holds back stays first in the queue
+//until the next call, see diag_exit() in main.c.
+void zone_next(void){
+	while(zone_queued && zone_open_count < ZONE_SUPPLY_MAX) {
+		if(!zone_start(zone_queue[0]))
+			break;
+		zone_queued--;
+		memmove(&zone_queue[0], &zone_queue[1], zone_queued);
+	}
+	if(!zone_open)
+		valve_close(0, BOARD_ENAC_D); //disable ENAC-
+}
+
+//***************************************************************************
+//
+// Function Name        : "zone_request"
+// Date                 : 10/18/26
+// Version              : 1.0
+// Target MCU           : AVR128DB48
+// Target Hardware      ; SSR valves
+// Author               : Brandon Guzy
+// DESCRIPTION
+// Asks for a fill or clean of ms milliseconds in a zone, what is ZONE_FILL
+// or ZONE_CLEAN. During a clean BB2 closes after bb2_ms, 0 leaves it open
+// to the end. The valves open right away if the supply allows, otherwise
+// once the zones ahead in the queue are done. zone_take_done() tells when
+// the time is up.
+//
+// Warnings             : none
+// Restrictions         : The zone must not be open or waiting, see
+//						  zone_release()
+// Algorithms           : none
+// References           : valve_arm()
+//
+// Revision History     : Initial version
+//
+//**************************************************************************
+void zone_request(uint8_t zone, uint8_t what, uint16_t ms, uint16_t bb2_ms){
+	zone_what[zone] = what;
+	zone_ms[zone] = ms;
+	zone_bb2_ms[zone] = bb2_ms;
+	zone_done &= ~(1 << zone);
+	zone_delay_end[zone] = clock_now() + (ms + 999) / 1000;	//moves on once it opens
+	zone_queue[zone_queued++] = zone;
+	zone_next();
+}
+
+//closes the valves of a zone, or takes it out of the queue, and lets the
+//next waiting zone have the supply
+void zone_release(uint8_t zone){
+	zone_pins_t pins;
+	uint8_t j = 0;
+	memcpy_P(&pins, &zone_pins[zone], sizeof(pins));
+	valve_disarm(VALVE_TIMER_BB2(zone));
+	valve_disarm(VALVE_TIMER_END(zone));
+	valve_close(pins.fill_a | pins.clean_a | pins.bb2_a, pins.fill_d | pins.clean_d | pins.bb2_d);
+	if(zone_open & (1 << zone)) {
+		zone_open &= ~(1 << zone);
+		zone_open_count--;
+	}
+	for (uint8_t i = 0; i < zone_queued; i++) {
+		if(zone_queue[i] != zone)
+			zone_queue[j++] = zone_queue[i];
+	}
+	zone_queued = j;
+	zone_done &= ~(1 << zone);
+	zone_next();
+}
+
+//called from the main loop, frees the supply of the zones whose time ran
+//out, TCB3 has already closed their valves
+void zone_task(void){
+	uint16_t expired = valve_take_expired();
+	if(!expired)
+		return;		//leaves ENAC- alone while the POST or diagnostics hold it on
+	for (uint8_t zone = 0; expired; zone++, expired >>= 2) {
+		if((expired & 1) && (zone_open & (1 << zone))) {
+			zone_open &= ~(1 << zone);
+			zone_open_count--;
+			zone_done |= 1 << zone;
+		}
+	}
+	zone_next();
+}
+
+//returns 1 once, when the fill or clean of a zone is over
+uint8_t zone_take_done(uint8_t zone){
+	if(!(zone_done & (1 << zone)))
+		return 0;
+	zone_done &= ~(1 << zone);
+	return 1;
+}